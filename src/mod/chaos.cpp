@@ -5,6 +5,9 @@
 
 #include <memory>
 #include <cstring>
+#include <vector>
+#include <deque>
+#include <algorithm>
 
 namespace Chaos {
     constexpr int FRAMES_PER_SECOND = 20;
@@ -32,33 +35,40 @@ namespace Chaos {
                 .initial_probability = 0.3f,
                 .on_pick_multiplier = 1.0f,
                 .winner_weight_share = 0.2f,
+                .sampler = ChaosSamplerBackend::TREE,
             },
             { /* CHAOS_DISTURBANCE_LOW */
                 .initial_probability = 0.2f,
                 .on_pick_multiplier = 1.0f,
                 .winner_weight_share = 0.5f,
+                .sampler = ChaosSamplerBackend::TREE,
             },
             { /* CHAOS_DISTURBANCE_MEDIUM */
                 .initial_probability = 0.1f,
                 .on_pick_multiplier = 1.0f,
                 .winner_weight_share = 0.8f,
+                .sampler = ChaosSamplerBackend::TREE,
             },
             { /* CHAOS_DISTURBANCE_HIGH */
                 .initial_probability = 0.05f,
                 .on_pick_multiplier = 0.8f,
                 .winner_weight_share = 1.0f,
+                .sampler = ChaosSamplerBackend::TREE,
             },
             { /* CHAOS_DISTURBANCE_VERY_HIGH */
                 .initial_probability = 0.01f,
                 .on_pick_multiplier = 0.8f,
                 .winner_weight_share = 1.0f,
+                .sampler = ChaosSamplerBackend::TREE,
             },
             { /* CHAOS_DISTURBANCE_NIGHTMARE */
                 .initial_probability = 0.0f,
                 .on_pick_multiplier = 0.5f,
                 .winner_weight_share = 1.0f,
+                .sampler = ChaosSamplerBackend::TREE,
             },
-        }
+        },
+        .unified_roll = false,
     };
 
     RECOMP_DECLARE_EVENT(chaos_on_init());
@@ -78,8 +88,35 @@ namespace Chaos {
     std::unique_ptr<finite_vector<ChaosMachine>> machines;
     u32 machine_count = 0;
 
-    std::unordered_set<ChaosEffect*> pause_fun_queue;
-    std::unordered_set<ChaosEffect*> unpause_fun_queue;
+    // Queues and tag buffers are reused, so that steady state tag changes don't allocate.
+    std::vector<ChaosEffect*> pause_fun_queue;
+    std::vector<ChaosEffect*> unpause_fun_queue;
+    Tag::combo_set affected_combos;
+    Tag::combo_set allowed_combos;
+    Tag::combo_set blocked_combos;
+    Tag::combo_set paused_combos;
+    Tag::combo_set unpaused_combos;
+
+    // Tag transitions waiting for a commit. Only the last one of a tag is kept.
+    dense_set<Tag::tag_id> pending_tags;
+    std::vector<bool> pending_forbidden; // indexed by tag id.
+    bool batch_tag_changes = false;
+
+    // Queued activations blocked by a tag wait on one of their blocking tags,
+    // in request order. Tags that became free are woken after the update.
+    std::vector<std::deque<ChaosEffectEntity*>> tag_wait_queues; // indexed by tag id.
+    dense_set<Tag::tag_id> released_tags;
+    dense_set<Tag::tag_id> waking_tags; // released tags swapped out while they're woken.
+
+    // Subgroups of all groups indexed by their combo, built once the trees exist.
+    // Subgroups of a combo are in range [subgroup_offsets[combo], subgroup_offsets[combo + 1]).
+    struct SubgroupSlot {
+        ChaosGroup* group;
+        u32 subgroup;
+    };
+
+    std::vector<u32> subgroup_offsets;
+    std::vector<SubgroupSlot> subgroup_slots;
 
     void alloc_effect_slots() {
         for (u32 i = 0; i < machine_count; i++) {
@@ -106,6 +143,8 @@ namespace Chaos {
         machine_count = 0;
 
         register_machine(DEFAULT_MACHINE_SETTINGS);
+
+        // Must stay in the order of the CHAOS_TAG_HANDLE_* constants.
         register_tag(CHAOS_TAG_PLAYER_INACTIVE, SIZE_MAX);
         register_tag(CHAOS_TAG_CUTSCENE, SIZE_MAX);
 
@@ -194,6 +233,10 @@ namespace Chaos {
                 entity.status = ChaosEffectStatus::AVAILABLE;
                 entity.owner = &group;
                 entity.combo = combo;
+                entity.is_waiting = false;
+                entity.active_node = NO_ACTIVE_NODE;
+                entity.cooldown = 0;
+                entity.instance_block = NO_INSTANCE_BLOCK;
 
                 return &entity;
             }
@@ -210,9 +253,31 @@ namespace Chaos {
         return NULL;
     }
 
+    ChaosEffectEntity* register_instanced_effect(ChaosMachine* machine, const ChaosEffect& effect,
+            Disturbance disturbance, const char* tag_names[], size_t tag_count,
+            const ChaosInstanceSettings& settings) {
+        if (settings.max_instances == 0) {
+            warning("Instanced chaos effects need at least one instance!");
+            return NULL;
+        }
+
+        ChaosEffectEntity* entity =
+            register_effect(machine, effect, disturbance, tag_names, tag_count);
+        if (entity != NULL) {
+            machine->add_effect_instances(*entity, settings);
+        }
+        return entity;
+    }
+
 
     void init() {
         Tag::clear();
+        pending_tags.clear();
+        tag_wait_queues.clear();
+        released_tags.clear();
+        waking_tags.clear();
+        subgroup_offsets.clear();
+        subgroup_slots.clear();
 
         state = State::MACHINE_COUNT;
 
@@ -262,6 +327,7 @@ namespace Chaos {
 
         for (u32 i = 0; i < machine_count; i++) {
             ChaosMachine& machine = (*machines)[i];
+            machine.alloc_active_effects();
             for (int j = 0; j < Disturbance::MAX; j++) {
                 ChaosGroup& group = machine.get_group(Disturbance(j));
                 group.init_tree();
@@ -278,16 +344,22 @@ namespace Chaos {
             }
         }
 
+        build_subgroup_index();
+
         state = State::RUN;
     }
 
     void update(GameCtx* ctx) {
         _ctx = ctx;
 
+        commit_tag_changes();
+
         for (u32 i = 0; i < get_machine_count(); i++) {
             ChaosMachine& machine = get_machine(i);
             machine.update();
         }
+
+        wake_waiting_effects();
     }
 
 
@@ -307,6 +379,9 @@ namespace Chaos {
             warning("Chaos effects can't be disabled before initalization!");
         }
 
+        // Stale queue entries are skipped on wake up.
+        entity.is_waiting = false;
+
         ChaosGroup& group = *entity.owner;
         ChaosMachine& machine = get_machine(group);
 
@@ -324,11 +399,72 @@ namespace Chaos {
         machine.activate_effect(entity);
     }
 
+    bool has_waiting_effects(Tag::tag_id tag) {
+        return (static_cast<size_t>(tag) < tag_wait_queues.size())
+            && !tag_wait_queues[tag].empty();
+    }
+
+    u32 get_effect_timer(const ChaosEffectEntity& entity) {
+        ChaosGroup& group = *entity.owner;
+        ChaosMachine& machine = get_machine(group);
+
+        return machine.get_timer(entity);
+    }
+
+    void set_effect_cooldown(ChaosEffectEntity& entity, u32 cooldown) {
+        entity.cooldown = cooldown;
+    }
+
+    u32 get_effect_instance_count(const ChaosEffectEntity& entity) {
+        ChaosGroup& group = *entity.owner;
+        ChaosMachine& machine = get_machine(group);
+
+        return machine.get_instance_count(entity);
+    }
+
+    void* get_effect_instance_state(const ChaosEffectEntity& entity, u32 instance) {
+        ChaosGroup& group = *entity.owner;
+        ChaosMachine& machine = get_machine(group);
+
+        return machine.get_instance_state(entity, instance);
+    }
+
+    void wait_for_tag(ChaosEffectEntity& entity, Tag::tag_id tag) {
+        if (static_cast<size_t>(tag) >= tag_wait_queues.size()) {
+            tag_wait_queues.resize(tag + 1);
+        }
+        tag_wait_queues[tag].push_back(&entity);
+        entity.is_waiting = true;
+    }
+
+    // Activates the effect, or lets it wait until its tags allow it.
+    void queue_effect(ChaosEffectEntity& entity) {
+        if (state < State::RUN) {
+            warning("Chaos effects can't be queued before initalization!");
+        }
+
+        if (entity.is_waiting) {
+            return;
+        }
+
+        Tag::tag_id tag = Tag::find_blocking_tag(entity.combo);
+        if (tag == Tag::NO_TAG) {
+            activate_effect(entity);
+            return;
+        }
+
+        wait_for_tag(entity, tag);
+        debug_log("Queued '%s' effect until its tags allow it.", entity.effect.name);
+    }
+
     void stop_effect(ChaosEffectEntity& entity) {
         if (state < State::RUN) {
             warning("Chaos effects can't be stopped before initalization!");
         }
 
+        // Stale queue entries are skipped on wake up.
+        entity.is_waiting = false;
+
         ChaosGroup& group = *entity.owner;
         ChaosMachine& machine = get_machine(group);
 
@@ -336,50 +472,140 @@ namespace Chaos {
     }
 
 
-    void forbid_tag(const char* tag) {
+    Tag::tag_id get_tag_handle(const char* tag) {
         if (state < State::RUN) {
-            warning("Tags can't be forbidden before initalization!");
+            warning("Tag handles can't be obtained before initalization!");
+        }
+
+        // Tags that no effect uses can't affect anything, so they're never created here.
+        Tag::tag_id id = Tag::find_tag_id(tag);
+        if (id == Tag::NO_TAG) {
+            warning("Unknown tag '%s'!", tag);
         }
+        return id;
+    }
 
-        Tag::tag_id id = Tag::get_tag_id(tag);
-        auto [res, affected] = Tag::exclude_tag(id);
-        if (!res) {
+    // Applies the net difference of the queued transitions. Tags that end up in
+    // their previous state are left untouched.
+    void commit_tag_changes() {
+        if (pending_tags.empty()) {
             return;
         }
-        deactivate_subgroups(affected);
 
-        auto& related = Tag::get_related_combos(id);
-        std::unordered_set<Tag::combo_id> pausable(related.begin(), related.end());
+        affected_combos.clear();
+        paused_combos.clear();
+        unpaused_combos.clear();
+        for (Tag::tag_id id : pending_tags) {
+            bool forbid = pending_forbidden[id];
+            bool modified = forbid
+                ? Tag::exclude_tag(id, affected_combos)
+                : Tag::include_tag(id, affected_combos);
+            if (!modified) {
+                continue;
+            }
+
+            Tag::combo_set& combos = forbid ? paused_combos : unpaused_combos;
+            for (auto combo : Tag::get_related_combos(id)) {
+                combos.insert(combo);
+            }
+
+            if (!forbid && !Tag::is_tag_blocked(id) && has_waiting_effects(id)) {
+                released_tags.insert(id);
+            }
+        }
+        pending_tags.clear();
+
+        allowed_combos.clear();
+        blocked_combos.clear();
+        for (auto combo : affected_combos) {
+            if (Tag::is_combo_allowed(combo)) {
+                allowed_combos.insert(combo);
+            } else {
+                blocked_combos.insert(combo);
+            }
+        }
+        deactivate_subgroups(blocked_combos);
+        activate_subgroups(allowed_combos);
+
+        // Combos can still be excluded through another tag.
+        affected_combos.clear();
+        for (auto combo : unpaused_combos) {
+            if (Tag::is_combo_included(combo)) {
+                affected_combos.insert(combo);
+            }
+        }
 
         for (size_t i = 0; i < machines->size(); i++) {
             auto& machine = (*machines)[i];
-            machine.pause_effects(pausable);
+            machine.pause_effects(paused_combos);
+            machine.unpause_effects(affected_combos);
         }
     }
 
-    void allow_tag(const char* tag) {
+    template <bool V>
+    void queue_tag_change(Tag::tag_id id) {
+        if (!Tag::is_tag_valid(id)) {
+            warning("Invalid tag handle %d!", id);
+            return;
+        }
+
+        if (static_cast<size_t>(id) >= pending_forbidden.size()) {
+            pending_forbidden.resize(id + 1);
+        }
+        pending_forbidden[id] = V;
+        pending_tags.insert(id);
+
+        if (!batch_tag_changes) {
+            commit_tag_changes();
+        }
+    }
+
+    void forbid_tag(Tag::tag_id id) {
+        if (state < State::RUN) {
+            warning("Tags can't be forbidden before initalization!");
+        }
+
+        queue_tag_change<true>(id);
+    }
+
+    void allow_tag(Tag::tag_id id) {
         if (state < State::RUN) {
             warning("Tags can't be allowed before initalization!");
         }
 
-        Tag::tag_id id = Tag::get_tag_id(tag);
-        auto [res, affected] = Tag::include_tag(id);
-        if (!res) {
-            return;
+        queue_tag_change<false>(id);
+    }
+
+    void forbid_tag(const char* tag) {
+        Tag::tag_id id = get_tag_handle(tag);
+        if (id != Tag::NO_TAG) {
+            forbid_tag(id);
         }
-        activate_subgroups(affected);
+    }
 
-        std::unordered_set<Tag::combo_id> reasumable;
-        auto& related = Tag::get_related_combos(id);
-        for (auto combo : related) {
-            if (Tag::is_combo_included(combo)) {
-                reasumable.insert(combo);
-            }
+    void allow_tag(const char* tag) {
+        Tag::tag_id id = get_tag_handle(tag);
+        if (id != Tag::NO_TAG) {
+            allow_tag(id);
+        }
+    }
+
+    bool is_tag_forbidden(Tag::tag_id id) {
+        if (!Tag::is_tag_valid(id)) {
+            warning("Invalid tag handle %d!", id);
+            return false;
         }
 
-        for (size_t i = 0; i < machines->size(); i++) {
-            auto& machine = (*machines)[i];
-            machine.unpause_effects(reasumable);
+        if (pending_tags.contains(id)) {
+            return pending_forbidden[id];
+        }
+        return Tag::is_tag_excluded(id);
+    }
+
+    void set_tag_batching(bool enabled) {
+        batch_tag_changes = enabled;
+        if (!enabled) {
+            commit_tag_changes();
         }
     }
 
@@ -406,6 +632,39 @@ namespace Chaos {
     }
 
 
+    size_t pick_effects(ChaosMachine& machine, size_t count, ChaosEffectEntity* out[],
+            bool share_weight) {
+        if (state < State::RUN) {
+            warning("Can't pick chaos effects before initalization!");
+            return 0;
+        }
+
+        return machine.pick_effects(count, out, share_weight);
+    }
+
+    size_t pick_effects(ChaosMachine& machine, Disturbance disturbance, size_t count,
+            ChaosEffectEntity* out[], bool share_weight) {
+        if (state < State::RUN) {
+            warning("Can't pick chaos effects before initalization!");
+            return 0;
+        }
+
+        return machine.pick_effects(disturbance, count, out, share_weight);
+    }
+
+    void commit_pick(ChaosEffectEntity& entity) {
+        if (state < State::RUN) {
+            warning("Can't commit chaos effect picks before initalization!");
+            return;
+        }
+
+        ChaosGroup& group = *entity.owner;
+        ChaosMachine& machine = get_machine(group);
+
+        machine.commit_pick(entity);
+    }
+
+
     size_t get_machine_count() {
         return machine_count;
     }
@@ -425,51 +684,133 @@ namespace Chaos {
     }
 
 
-    void activate_subgroups(const std::unordered_set<Tag::combo_id>& subgroups) {
-        for (u32 i = 0; i < machine_count; i++) {
-            ChaosMachine& machine = (*machines)[i];
-            for (int j = 0; j < Disturbance::MAX; j++) {
-                ChaosGroup& group = machine.get_group(Disturbance(j));
-                for (Tag::combo_id combo : subgroups) {
-                    group.activate_subgroup(combo);
+    void release_waiting_effects(Tag::combo_id combo) {
+        for (Tag::tag_id tag : Tag::get_combo_tags(combo)) {
+            if (!Tag::is_tag_blocked(tag) && has_waiting_effects(tag)) {
+                released_tags.insert(tag);
+            }
+        }
+    }
+
+    // Starts waiting effects in order while their tags allow it. An effect
+    // still blocked by another tag moves to the queue of that tag. Effects that
+    // were rolled or disabled while waiting are dropped from the queue.
+    //
+    // Starting an effect can release more tags, which are woken in the next
+    // update. Moving an effect can grow the queues, so they're indexed anew
+    // on every step.
+    void wake_waiting_effects() {
+        std::swap(released_tags, waking_tags);
+
+        for (Tag::tag_id tag : waking_tags) {
+            while (!tag_wait_queues[tag].empty()) {
+                ChaosEffectEntity& entity = *tag_wait_queues[tag].front();
+                if (!entity.is_waiting || (entity.status != ChaosEffectStatus::AVAILABLE)) {
+                    tag_wait_queues[tag].pop_front();
+                    entity.is_waiting = false;
+                    continue;
+                }
+
+                Tag::tag_id blocking_tag = Tag::find_blocking_tag(entity.combo);
+                if (blocking_tag == tag) {
+                    break;
+                }
+
+                tag_wait_queues[tag].pop_front();
+                entity.is_waiting = false;
+
+                if (blocking_tag == Tag::NO_TAG) {
+                    activate_effect(entity);
+                } else {
+                    wait_for_tag(entity, blocking_tag);
                 }
             }
         }
+        waking_tags.clear();
     }
 
-    void deactivate_subgroups(const std::unordered_set<Tag::combo_id>& subgroups) {
-        for (u32 i = 0; i < machine_count; i++) {
-            ChaosMachine& machine = (*machines)[i];
-            for (int j = 0; j < Disturbance::MAX; j++) {
-                ChaosGroup& group = machine.get_group(Disturbance(j));
-                for (Tag::combo_id combo : subgroups) {
-                    group.deactivate_subgroup(combo);
+    void build_subgroup_index() {
+        size_t combo_count = Tag::get_combo_count();
+
+        subgroup_offsets.clear();
+        subgroup_offsets.reserve(combo_count + 1);
+        subgroup_slots.clear();
+
+        for (size_t combo = 0; combo < combo_count; combo++) {
+            subgroup_offsets.push_back(subgroup_slots.size());
+
+            for (u32 i = 0; i < machine_count; i++) {
+                ChaosMachine& machine = (*machines)[i];
+                for (int j = 0; j < Disturbance::MAX; j++) {
+                    ChaosGroup& group = machine.get_group(Disturbance(j));
+                    u32 subgroup = group.find_subgroup(combo);
+                    if (subgroup != ChaosGroup::NO_SUBGROUP) {
+                        subgroup_slots.push_back({ &group, subgroup });
+                    }
                 }
             }
         }
+        subgroup_offsets.push_back(subgroup_slots.size());
     }
 
+    // Combos created after the initialization have no effects, thus no subgroups.
+    template <bool V>
+    void set_subgroups_active(const Tag::combo_set& subgroups) {
+        size_t indexed_count = subgroup_offsets.empty() ? 0 : subgroup_offsets.size() - 1;
 
-    void queue_pause_fun(ChaosEffect* effect) {
-        if (!unpause_fun_queue.erase(effect)) {
-            pause_fun_queue.insert(effect);
+        for (Tag::combo_id combo : subgroups) {
+            if (static_cast<size_t>(combo) >= indexed_count) {
+                continue;
+            }
+
+            for (u32 k = subgroup_offsets[combo]; k < subgroup_offsets[combo + 1]; k++) {
+                SubgroupSlot& slot = subgroup_slots[k];
+                if constexpr (V) {
+                    slot.group->activate_subgroup(slot.subgroup);
+                } else {
+                    slot.group->deactivate_subgroup(slot.subgroup);
+                }
+            }
         }
     }
 
-    void queue_unpause_fun(ChaosEffect* effect) {
-        if (!pause_fun_queue.erase(effect)) {
-            unpause_fun_queue.insert(effect);
+    void activate_subgroups(const Tag::combo_set& subgroups) {
+        set_subgroups_active<true>(subgroups);
+    }
+
+    void deactivate_subgroups(const Tag::combo_set& subgroups) {
+        set_subgroups_active<false>(subgroups);
+    }
+
+
+    // A queued call cancels out a queued call of the opposite kind.
+    void queue_fun(std::vector<ChaosEffect*>& queue, std::vector<ChaosEffect*>& opposite_queue,
+            ChaosEffect* effect) {
+        auto it = std::find(opposite_queue.begin(), opposite_queue.end(), effect);
+        if (it != opposite_queue.end()) {
+            *it = opposite_queue.back();
+            opposite_queue.pop_back();
+        } else if (std::find(queue.begin(), queue.end(), effect) == queue.end()) {
+            queue.push_back(effect);
         }
     }
 
+    void queue_pause_fun(ChaosEffect* effect) {
+        queue_fun(pause_fun_queue, unpause_fun_queue, effect);
+    }
+
+    void queue_unpause_fun(ChaosEffect* effect) {
+        queue_fun(unpause_fun_queue, pause_fun_queue, effect);
+    }
+
     void execute_fun_queues() {
-        for (ChaosEffect* effect : pause_fun_queue) {
-            effect->on_pause_fun(_ctx);
+        for (size_t i = 0; i < pause_fun_queue.size(); i++) {
+            pause_fun_queue[i]->on_pause_fun(_ctx);
         }
         pause_fun_queue.clear();
 
-        for (ChaosEffect* effect : unpause_fun_queue) {
-            effect->on_unpause_fun(_ctx);
+        for (size_t i = 0; i < unpause_fun_queue.size(); i++) {
+            unpause_fun_queue[i]->on_unpause_fun(_ctx);
         }
         unpause_fun_queue.clear();
     }
@@ -510,6 +851,21 @@ namespace Chaos {
             get_machine_or_null(0), *effect, disturbance, tag_names, tag_count);
     }
 
+    RECOMP_EXPORT ChaosEffectEntity* chaos_register_instanced_effect_to(
+            ChaosMachine* machine, const ChaosEffect* effect,
+            Disturbance disturbance, const char* tag_names[], size_t tag_count,
+            const ChaosInstanceSettings* settings) {
+        return register_instanced_effect(
+            machine, *effect, disturbance, tag_names, tag_count, *settings);
+    }
+
+    RECOMP_EXPORT ChaosEffectEntity* chaos_register_instanced_effect(
+            const ChaosEffect* effect, Disturbance disturbance,
+            const char* tag_names[], size_t tag_count, const ChaosInstanceSettings* settings) {
+        return register_instanced_effect(
+            get_machine_or_null(0), *effect, disturbance, tag_names, tag_count, *settings);
+    }
+
 
     RECOMP_EXPORT void chaos_activate_effect(ChaosEffectEntity* entity) {
         activate_effect(*entity);
@@ -527,6 +883,26 @@ namespace Chaos {
         stop_effect(*entity);
     }
 
+    RECOMP_EXPORT void chaos_queue_effect(ChaosEffectEntity* entity) {
+        queue_effect(*entity);
+    }
+
+    RECOMP_EXPORT u32 chaos_get_effect_timer(ChaosEffectEntity* entity) {
+        return get_effect_timer(*entity);
+    }
+
+    RECOMP_EXPORT void chaos_set_effect_cooldown(ChaosEffectEntity* entity, u32 cooldown) {
+        set_effect_cooldown(*entity, cooldown);
+    }
+
+    RECOMP_EXPORT u32 chaos_get_effect_instance_count(ChaosEffectEntity* entity) {
+        return get_effect_instance_count(*entity);
+    }
+
+    RECOMP_EXPORT void* chaos_get_effect_instance_state(ChaosEffectEntity* entity, u32 instance) {
+        return get_effect_instance_state(*entity, instance);
+    }
+
 
     RECOMP_EXPORT void chaos_request_roll(ChaosMachine* machine) {
         request_roll(*machine);
@@ -548,6 +924,30 @@ namespace Chaos {
     }
 
 
+    RECOMP_EXPORT u32 chaos_pick_effects(
+        ChaosMachine* machine, u32 count, ChaosEffectEntity* out[], bool share_weight) {
+        return pick_effects(*machine, count, out, share_weight);
+    }
+
+    RECOMP_EXPORT u32 chaos_pick_group_effects(ChaosMachine* machine, Disturbance disturbance,
+        u32 count, ChaosEffectEntity* out[], bool share_weight) {
+        return pick_effects(*machine, disturbance, count, out, share_weight);
+    }
+
+    RECOMP_EXPORT void chaos_commit_pick(ChaosEffectEntity* entity) {
+        commit_pick(*entity);
+    }
+
+
+    RECOMP_EXPORT u32 chaos_get_machine_seed(ChaosMachine* machine) {
+        return machine->get_seed();
+    }
+
+    RECOMP_EXPORT void chaos_set_machine_seed(ChaosMachine* machine, u32 seed) {
+        machine->set_seed(seed);
+    }
+
+
     RECOMP_EXPORT void chaos_forbid_tag(const char* tag) {
         forbid_tag(tag);
     }
@@ -555,4 +955,24 @@ namespace Chaos {
     RECOMP_EXPORT void chaos_allow_tag(const char* tag) {
         allow_tag(tag);
     }
+
+    RECOMP_EXPORT ChaosTagHandle chaos_get_tag_handle(const char* tag) {
+        return get_tag_handle(tag);
+    }
+
+    RECOMP_EXPORT void chaos_forbid_tag_handle(ChaosTagHandle handle) {
+        forbid_tag(handle);
+    }
+
+    RECOMP_EXPORT void chaos_allow_tag_handle(ChaosTagHandle handle) {
+        allow_tag(handle);
+    }
+
+    RECOMP_EXPORT bool chaos_is_tag_forbidden(ChaosTagHandle handle) {
+        return is_tag_forbidden(handle);
+    }
+
+    RECOMP_EXPORT void chaos_set_tag_batching(bool enabled) {
+        set_tag_batching(enabled);
+    }
 }
@@ -22,6 +22,7 @@ extern "C" {
 #endif
 
 typedef PlayState GameCtx;
+typedef s32 ChaosTagHandle;
 
 void chaos_init(void);
 void chaos_update(GameCtx* play);
@@ -29,6 +30,8 @@ void chaos_execute_fun_queues(void);
 
 void chaos_forbid_tag(const char* tag);
 void chaos_allow_tag(const char* tag);
+void chaos_forbid_tag_handle(ChaosTagHandle handle);
+void chaos_allow_tag_handle(ChaosTagHandle handle);
 
 extern bool chaos_is_player_active;
 
@@ -40,13 +43,18 @@ extern bool chaos_is_player_active;
 
 #include "util/static_vector.h"
 #include "util/finite_vector.h"
+#include "util/weight.h"
+#include "util/xoshiro.h"
+#include "util/timer_wheel.h"
 
 #include <memory>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 namespace Chaos {
     typedef void (*ChaosFunction)(GameCtx* play);
+    typedef void (*ChaosInstanceFunction)(GameCtx* play, u32 instance, void* state);
 
     enum Disturbance : int {
         VERY_LOW,
@@ -69,6 +77,19 @@ namespace Chaos {
         ChaosFunction on_unpause_fun;
     } ChaosEffect;
 
+    // Effects registered with instance settings can run several times at once.
+    // Every activation gets its own instance, and with it a zeroed state block
+    // from a pool allocated at initialization. The instance callbacks replace
+    // the start, update and end callbacks of the effect.
+    typedef struct {
+        u32 max_instances;
+        u32 state_size; // In bytes.
+
+        ChaosInstanceFunction on_start_fun;
+        ChaosInstanceFunction update_fun;
+        ChaosInstanceFunction on_end_fun;
+    } ChaosInstanceSettings;
+
 
     enum ChaosEffectStatus {
         AVAILABLE,
@@ -77,6 +98,12 @@ namespace Chaos {
         DISABLED,
     };
 
+#ifdef CHAOS_FIXED_WEIGHTS
+    using ChaosWeight = fixed_weight;
+#else
+    using ChaosWeight = float_weight;
+#endif
+
     class ChaosGroup;
 
     typedef struct {
@@ -84,144 +111,181 @@ namespace Chaos {
         ChaosEffectStatus status;
         ChaosGroup* owner;
         Tag::combo_id combo;
+        bool is_waiting; // parked in a tag wait queue.
+        u32 active_node; // node in the active effect list of its machine.
+        u32 cooldown;    // frames spent HIDDEN after ending.
+        u32 instance_block; // instances in the active effect list, if it has any.
     } ChaosEffectEntity;
 
+    constexpr u32 NO_ACTIVE_NODE = UINT32_MAX;
+    constexpr u32 NO_INSTANCE_BLOCK = UINT32_MAX;
+
+
+    // The alias table survives status changes, as draws of unavailable effects
+    // are rejected. A winner weight share changes every weight on every roll
+    // though, so the table only pays off for groups without it, see
+    // tests/bench_group.cpp.
+    enum ChaosSamplerBackend : int {
+        TREE,  // O(log n) descent, no upkeep.
+        ALIAS, // O(1) expected draws, O(n) rebuild after any weight change.
+    };
 
     typedef struct {
         double initial_probability;
         double on_pick_multiplier;
         double winner_weight_share;
+        ChaosSamplerBackend sampler;
     } ChaosGroupSettings;
 
     typedef struct {
         const char* name;
         u32 cycle_length;
         ChaosGroupSettings default_groups_settings[Disturbance::MAX];
+        bool unified_roll; // One random number picks both the group and the effect.
     } ChaosMachineSettings;
 
 
     class ChaosGroup {
     private:
-        struct EffectTree;
-
-        struct EffectSubtree {
-            struct Node {
-                ChaosEffectEntity effect;
-                double weight_deviation = 0.0;
-                double left_deviation_sum = 0.0; // sum of weight deviations of active
-                                                 // nodes in left subtree.
-                size_t left_count = 0;      // number of active nodes in left subtree.
+        template <typename Weight>
+        struct BasicEffectTree {
+            using Value = typename Weight::value_type;
+
+            struct Subgroup {
+                Tag::combo_id combo;
+                u32 offset = 0; // position of the subgroup's first effect.
+                u32 size = 0;
                 bool is_active = true;
-            };
-
-            EffectTree& owner;
-            bool is_active = true;
 
-            size_t _size = 0;
-            std::unique_ptr<Node[]> nodes;
-            size_t count = 0;
-            double deviation_sum = 0;
-
-            EffectSubtree(EffectTree& owner) : owner(owner) {};
+                Value deviation_sum = Weight::zero; // sum of weight deviations of active effects.
+                u32 count = 0;                      // number of active effects.
+                u32 odd_count = 0;                  // number of active effects with odd epoch parity.
+            };
 
-            // size_t size();
-            double get_weight(Node& node) const;
-            double get_left_weight(Node& node) const;
+            // Hot weight data is kept as a structure of arrays carved out of a single
+            // allocation. The Fenwick trees of the top level (one leaf per subgroup)
+            // and of every subgroup (one leaf per effect) are stored back to back,
+            // so a pick or an update only walks a few dense arrays.
+            std::unique_ptr<u64[]> storage;
+            Value* fenwick_deviations = nullptr;  // sums of weight deviations of active leaves.
+            u32* fenwick_counts = nullptr;        // numbers of active leaves.
+            u32* fenwick_odd_counts = nullptr;    // numbers of active leaves with odd epoch parity.
+            Value* deviations = nullptr;          // weight deviation of every effect.
+            u8* epochs = nullptr;                 // parity of the epoch each deviation is relative to.
+            bool* actives = nullptr;              // whether the effect is counted in its subgroup.
+
+            std::unique_ptr<ChaosEffectEntity[]> entities; // cold data, in the same order.
+
+            std::vector<Subgroup> subgroups; // in order of first reservation.
+            std::vector<u32> subgroup_indices; // indexed by combo_id.
+
+            u32 count = 0;
+            u32 odd_count = 0;
+            Value deviation_sum = Weight::zero;
+            Value shared_weight = Weight::one; // per effect.
+            Value shared_weight_error = Weight::zero; // compensation of its rounding error.
+
+            // Weight of an effect is its deviation plus the shared weight minus the
+            // base of its epoch. Effects are lazily moved to a fresh base whenever
+            // the shared weight grows too large, which keeps the stored values
+            // small without ever touching the whole tree at once. Exact weights
+            // wrap around instead and never need a new base.
+            Value epoch_bases[2] = { Weight::zero, Weight::zero };
+            u8 epoch = 0;
+            bool is_rebasing = false;
+            size_t rebased_count = 0;
+            size_t rebase_subgroup = 0;
+            size_t rebase_pos = 0;
+
+            // Fenwick nodes are recomputed from their children a few at a time,
+            // which keeps the sums from drifting away from the stored deviations.
+            size_t repair_subgroup = 0; // subgroup count for the top level.
+            size_t repair_pos = 0;
+
+            size_t total_effect_count = 0;
+            u32 revision = 0; // bumped on every weight change, status changes keep it.
+
+            Value get_offset(u8 node_epoch) const;
+            Value get_offset_weight(u32 node_count, u32 node_odd_count) const;
+            Value get_fenwick_weight(size_t pos) const;
+            Value get_weight(u32 effect) const;
+            Value get_weight_sum() const;
 
-            size_t reserve_slot();
+            size_t reserve_slot(Tag::combo_id combo);
             void reset_size();
             void alloc_nodes();
 
-            bool is_counted(Node& node) const;
-            double get_deviation(Node& node) const;
+            bool is_counted(Tag::combo_id combo) const;
             void init_tree();
-            void update_deviations_upwards(Node& node, double delta);
-            void update_count(Node& node, size_t delta);
-
-            Node& get_node(double weight);
-            size_t get_pos(Node& node);
+            void rebuild();
+            void fenwick_build(size_t base, size_t size);
+            Value fenwick_sum(size_t base, size_t size, u32* count_out, u32* odd_count_out) const;
+            void fenwick_add(size_t base, size_t size, size_t pos,
+                Value delta, u32 count_delta, u32 odd_delta);
+            size_t fenwick_find(size_t base, size_t size, Value weight, Value* local_weight_out);
+            void update_effect(u32 subgroup, u32 effect,
+                Value delta, u32 count_delta, u32 odd_delta);
+            void update_subgroup(u32 subgroup, Value delta, u32 count_delta, u32 odd_delta);
+
+            u32 find_subgroup(Tag::combo_id combo) const;
+            u32 get_subgroup(Tag::combo_id combo) const;
+            u32 get_effect(Value weight, u32* subgroup_out);
+            void add_shared_weight(Value delta);
+            void share_weight(u32 subgroup, u32 effect, double share);
+            void activate_node(u32 subgroup, u32 effect);
+            void deactivate_node(u32 subgroup, u32 effect);
+            void exclude_node(u32 subgroup, u32 effect);
+            void include_node(u32 subgroup, u32 effect);
+            void activate_subgroup(u32 subgroup);
+            void deactivate_subgroup(u32 subgroup);
+            void repair_fenwick_node(size_t base, size_t pos, Value leaf_deviation);
+            void reduce_weight_share_error(size_t node_budget);
+            void normalize_weight_share();
+            void rebase_node(u32 subgroup, u32 effect);
+            void continue_rebase(size_t node_budget);
         };
 
-        struct EffectTree {
-            struct Info {
-                double left_deviation_sum; // sum of weight deviations of active
-                                           // weights in left subtree.
-                size_t left_count;      // number of active nodes in left subtree.
-            };
+        using EffectTree = BasicEffectTree<ChaosWeight>;
+        using EffectIterator = ChaosEffectEntity*;
 
-            union Node {
-                Info info; // inner nodes.
-                Tag::combo_id combo; // leaves.
-            };
+        // Vose alias table over all effects of the tree, counted or not. Rebuilt
+        // lazily when the tree revision it was built from becomes outdated.
+        template <typename Weight>
+        struct BasicAliasTable {
+            using Value = typename Weight::value_type;
+            using EffectTree = BasicEffectTree<Weight>;
 
-            struct SubgroupData {
-                EffectSubtree subtree;
-                size_t node_pos; // position of combo_id node in tree.
+            struct Entry {
+                u32 effect;
+                u32 subgroup;
             };
 
-            std::unique_ptr<Node[]> nodes;
+            std::unique_ptr<Entry[]> entries;
+            std::unique_ptr<Value[]> thresholds; // out of capacity.
+            std::unique_ptr<u32[]> aliases;
+            std::unique_ptr<u32[]> worklist;
             size_t count = 0;
-            double deviation_sum = 0;
-            double shared_weight = 1.0; // per effect.
-            std::unordered_map<Tag::combo_id, SubgroupData> subgroups;
-
-            size_t total_effect_count;
-
-            size_t size();
-            double get_weight(EffectSubtree::Node& node) const;
-            double get_weight_sum() const;
-            double get_left_weight(Node& node) const;
-
-            size_t reserve_slot(Tag::combo_id combo);
-            void reset_size();
-            void alloc_nodes();
-
-            bool is_counted(Tag::combo_id combo) const;
-            void init_tree();
-            void update_deviations_upwards(Tag::combo_id combo, double delta);
-            void update_count(Tag::combo_id combo, size_t delta);
-            void update_deviations_upwards(
-                EffectSubtree::Node& node, EffectSubtree& subgroup, double delta);
-            void update_counts_upwards(
-                EffectSubtree::Node& start, EffectSubtree& subgroup, size_t delta);
-
-            ChaosGroup::EffectSubtree& get_subgroup(Tag::combo_id combo);
-            ChaosGroup::EffectSubtree& get_subgroup(double weight, double* local_weight_out = nullptr);
-            void share_weight(EffectSubtree::Node& node, EffectSubtree& subgroup, double share);
-            void activate_node(EffectSubtree::Node& node, EffectSubtree& subgroup);
-            void deactivate_node(EffectSubtree::Node& node, EffectSubtree& subgroup);
-            void activate_subgroup(Tag::combo_id combo);
-            void deactivate_subgroup(Tag::combo_id combo);
-            void reduce_weight_share_error();
-            void normalize_weight_share();
-        };
-
-        struct EffectIterator {
-            using iterator_category = std::forward_iterator_tag;
-            using value_type = ChaosEffectEntity;
-            using difference_type = std::ptrdiff_t;
-            using pointer = ChaosEffectEntity*;
-            using reference = ChaosEffectEntity&;
-
-            std::unordered_map<Tag::combo_id, EffectTree::SubgroupData>::iterator tree_it;
-            size_t subtree_pos;
-
-            ChaosEffectEntity& operator*() const;
-            EffectIterator& operator++();
-            EffectIterator operator++(int) {
-                auto tmp = *this;
-                ++*this;
-                return tmp;
-            }
-            bool operator==(const EffectIterator& other) const;
+            Value capacity = Weight::zero; // mass of a single bucket.
+            u32 revision = 0;
+            bool is_built = false;
+
+            void alloc(size_t size);
+            bool is_outdated(const EffectTree& tree) const;
+            void build(EffectTree& tree);
+            const Entry& sample(double rand) const;
         };
 
         ChaosGroupSettings settings;
         double probability;
 
+        using AliasTable = BasicAliasTable<ChaosWeight>;
+
         EffectTree tree;
+        AliasTable alias_table;
 
     public:
+        static constexpr u32 NO_SUBGROUP = UINT32_MAX;
+
         ChaosGroup(const ChaosGroupSettings& settings);
 
         double get_probability() const;
@@ -240,53 +304,147 @@ namespace Chaos {
         double get_effect_weight(ChaosEffectEntity& effect);
 
         void init_tree();
+        void reduce_weight_error();
         double get_weight_sum() const;
         ChaosEffectEntity& get_effect_entity_by_weight(double weight);
-        ChaosEffectEntity& get_effect_entity_by_weight(EffectSubtree& tree, double weight);
 
-        ChaosEffectEntity& pick_effect(double rand = -1);
+        ChaosEffectEntity& pick_effect(xoshiro128& rng, double rand = -1);
         ChaosEffectEntity& pick_effect_by_weight(double weight);
+        size_t pick_effects(size_t count, ChaosEffectEntity* out[], bool share_weight,
+            xoshiro128& rng);
+        ChaosEffectEntity* draw_effect(double rand);
+        void restore_drawn_effect(ChaosEffectEntity& effect);
+        void commit_pick(ChaosEffectEntity& effect);
         void set_effect_status(ChaosEffectEntity& effect, ChaosEffectStatus status);
-        void activate_subgroup(Tag::combo_id combo);
-        void deactivate_subgroup(Tag::combo_id combo);
+        void set_effect_rollable(ChaosEffectEntity& effect, bool is_rollable);
+        u32 find_subgroup(Tag::combo_id combo) const;
+        void activate_subgroup(u32 subgroup);
+        void deactivate_subgroup(u32 subgroup);
 
     private:
-        // size_t root_tree_size() const;
         u32 get_effect_entity_pos(ChaosEffectEntity& entity);
+        ChaosEffectEntity& finish_pick(u32 subgroup, u32 effect);
+        u32 get_effect_by_alias(double rand, xoshiro128& rng, u32* subgroup_out);
     };
 
     class ActiveChaosEffectList {
     private:
+        enum List : u8 {
+            RUNNING,
+            PAUSED,
+            REMOVED, // waiting for the end of the update.
+            COOLING, // ended, the effect stays HIDDEN until the deadline.
+            FREE,
+            LIST_COUNT,
+        };
+
+        // Nodes live in a slab allocated once at initialization and are linked
+        // by index into one list per state. Running and paused nodes are also
+        // linked into a list per combo, so that pausing touches only the
+        // effects of affected combos. Entities point back to their node.
         struct Node {
             ChaosEffectEntity* effect;
             ChaosGroup* group;
-            u32 timer;
-            std::unique_ptr<Node> next;
+            u64 start_frame; // while running, elapsed frames are derived from it.
+            u32 timer;       // elapsed frames, kept while not running.
+            u32 prev;
+            u32 next;
+            u32 combo_prev;
+            u32 combo_next;
+            u32 update_slot; // entry in the update table, if it has an update callback.
+            u32 instance;    // in the instance pool, if the effect is instanced.
+            List list;
         };
 
-        std::unique_ptr<Node> root;
-        std::unique_ptr<Node> pause_root;
-        std::unique_ptr<Node> remove_root;
+        // Instances of an effect take consecutive slots of the instance pool.
+        // An instanced effect is ACTIVE, and holds its tags, from the start of
+        // its first instance to the end of its last one. It stays in the weight
+        // tree until all of its instances run.
+        struct InstanceBlock {
+            ChaosInstanceSettings settings;
+            u32 first_instance;
+            u32 state_offset; // in words of the state pool.
+            u32 state_stride; // in words.
+            u32 free_count;   // free instances are stacked at the start of the block.
+        };
+
+        static constexpr u32 NO_INSTANCE = UINT32_MAX;
+
+        // Update callbacks of running effects, swept every frame without
+        // touching the nodes. Entries removed during a sweep keep their slot
+        // until they're compacted after it, and a node linked again during
+        // the same sweep takes its slot back, so every node has at most one.
+        // A slot taken back by a new activation is pending until then, as
+        // the new effect is first updated in the next frame.
+        struct UpdateEntry {
+            ChaosFunction update_fun;
+            ChaosInstanceFunction instance_update_fun;
+            void* state;
+            u32 instance; // within its block.
+            u32 node;
+            bool is_removed;
+            bool is_pending;
+        };
+
+        std::unique_ptr<Node[]> nodes;
+        u32 capacity = 0;
+        u32 heads[LIST_COUNT];
+        std::vector<u32> combo_heads[List::REMOVED]; // indexed by combo id.
+
+        std::unique_ptr<UpdateEntry[]> update_entries;
+        u32 update_count = 0;
+        bool is_sweeping = false;
+        bool has_removed_updates = false;
+
+        // Running effects expire through a timer wheel keyed on frames. Paused
+        // effects leave the wheel and get a shifted deadline once unpaused.
+        u64 frame = 0;
+        timer_wheel deadlines;
+        std::unique_ptr<u32[]> expired_nodes;
+
+        std::vector<InstanceBlock> instance_blocks;
+        std::unique_ptr<u64[]> instance_states;
+        std::unique_ptr<u32[]> free_instances;
+        std::unique_ptr<u32[]> instance_nodes; // NO_ACTIVE_NODE while free.
+        std::unique_ptr<u64[]> ending_state; // copy passed to end callbacks.
+        u32 instance_count = 0;
+        u32 state_word_count = 0;
+        u32 max_state_stride = 0;
 
     public:
+        u32 add_instance_block(const ChaosInstanceSettings& settings);
+        void alloc(u32 capacity);
         void queue_for_remove_entity(ChaosEffectEntity& entity);
         void add(ChaosGroup& group, ChaosEffectEntity& entity);
 
         void update();
         void empty_remove_queue();
 
-        void pause_effects(const std::unordered_set<Tag::combo_id>& affected_combos);
-        void unpause_effects(const std::unordered_set<Tag::combo_id>& affected_combos);
+        void pause_effects(const Tag::combo_set& affected_combos);
+        void unpause_effects(const Tag::combo_set& affected_combos);
 
         u32 get_timer(const ChaosEffectEntity& effect) const;
+        u32 get_instance_count(const ChaosEffectEntity& effect) const;
+        void* get_instance_state(const ChaosEffectEntity& effect, u32 instance) const;
 
     private:
-        void move_node(
-            std::unique_ptr<Node>& from_root, std::unique_ptr<Node>& to_root, Node* element);
-        void move_nodes(
-            std::unique_ptr<Node>& from_root,std::unique_ptr<Node>& to_root,
-            const std::unordered_set<Tag::combo_id>& affected_combos);
-        void remove_after(Node* element);
+        void* get_state(const InstanceBlock& block, u32 instance) const;
+        u32 take_instance(ChaosEffectEntity& entity);
+        void free_instance(ChaosEffectEntity& entity, u32 instance);
+        void start_node(u32 node);
+        void update_node(u32 node);
+        void end_node(u32 node);
+        u32& get_combo_head(List list, Tag::combo_id combo);
+        void add_update(u32 node);
+        void remove_update(u32 node);
+        void compact_updates();
+        void link(u32 node, List list);
+        void unlink(u32 node);
+        void move_node(u32 node, List list);
+        void move_nodes(List from, List to, const Tag::combo_set& affected_combos);
+        void remove(u32 node);
+        void release(u32 node);
+        void finish_cooldown(u32 node);
     };
 
     class ChaosMachine {
@@ -297,19 +455,32 @@ namespace Chaos {
         ActiveChaosEffectList active_effects;
         u8 roll_requests = 0;
         u8 group_roll_requests[Disturbance::MAX];
+        u32 seed;
+        xoshiro128 rng; // used for every roll, so that a seed replays the same rolls.
 
     public:
         ChaosMachine(const ChaosMachineSettings& settings);
 
         ChaosMachineSettings& get_settings();
+        u32 get_seed() const;
+        void set_seed(u32 seed);
+        double get_random();
         Disturbance get_group_disturbance(ChaosGroup* group) const;
         ChaosGroup& get_group(Disturbance disturbance);
-        ChaosGroup* pick_group(double rand = -1);
+        ChaosGroup* pick_group(double rand = -1, double* residual_out = nullptr);
+        ChaosGroup* pick_nonempty_group(double rand);
 
         void perform_roll(ChaosGroup& group, double rand = -1);
         void perform_roll(Disturbance disturbance, double rand = -1);
         void perform_roll(double group_rand = -1, double effect_rand = -1);
 
+        size_t pick_effects(size_t count, ChaosEffectEntity* out[], bool share_weight = true);
+        size_t pick_effects(Disturbance disturbance, size_t count, ChaosEffectEntity* out[],
+            bool share_weight = true);
+        void commit_pick(ChaosEffectEntity& entity);
+
+        void add_effect_instances(ChaosEffectEntity& entity, const ChaosInstanceSettings& settings);
+        void alloc_active_effects();
         void update();
 
         void enable_effect(ChaosEffectEntity& entity);
@@ -318,9 +489,11 @@ namespace Chaos {
         void stop_effect(ChaosEffectEntity& entity);
 
         u32 get_timer(const ChaosEffectEntity& entity) const;
+        u32 get_instance_count(const ChaosEffectEntity& entity) const;
+        void* get_instance_state(const ChaosEffectEntity& entity, u32 instance) const;
 
-        void pause_effects(const std::unordered_set<Tag::combo_id>& affected_combos);
-        void unpause_effects(const std::unordered_set<Tag::combo_id>& affected_combos);
+        void pause_effects(const Tag::combo_set& affected_combos);
+        void unpause_effects(const Tag::combo_set& affected_combos);
     };
 
 
@@ -333,6 +506,9 @@ namespace Chaos {
     ChaosEffectEntity* register_effect(
         ChaosMachine* machine, const ChaosEffect& effect, Disturbance disturbance,
         const char* tag_names[], size_t tag_count);
+    ChaosEffectEntity* register_instanced_effect(
+        ChaosMachine* machine, const ChaosEffect& effect, Disturbance disturbance,
+        const char* tag_names[], size_t tag_count, const ChaosInstanceSettings& settings);
 
     void init();
     void update(GameCtx* ctx);
@@ -340,19 +516,39 @@ namespace Chaos {
     void enable_effect(ChaosEffectEntity& entity);
     void disable_effect(ChaosEffectEntity& entity);
     void activate_effect(ChaosEffectEntity& entity);
+    void queue_effect(ChaosEffectEntity& entity);
     void stop_effect(ChaosEffectEntity& entity);
-
+    u32 get_effect_timer(const ChaosEffectEntity& entity);
+    void set_effect_cooldown(ChaosEffectEntity& entity, u32 cooldown);
+    u32 get_effect_instance_count(const ChaosEffectEntity& entity);
+    void* get_effect_instance_state(const ChaosEffectEntity& entity, u32 instance);
+
+    Tag::tag_id get_tag_handle(const char* tag);
+    void forbid_tag(Tag::tag_id id);
+    void allow_tag(Tag::tag_id id);
     void forbid_tag(const char* tag);
     void allow_tag(const char* tag);
+    bool is_tag_forbidden(Tag::tag_id id);
+    void set_tag_batching(bool enabled);
+    void commit_tag_changes();
 
     void request_roll(ChaosMachine& machine, double group_rand = -1, double effect_rand = -1);
     void request_roll(ChaosMachine& machine, Disturbance disturbance, double rand = -1);
 
+    size_t pick_effects(ChaosMachine& machine, size_t count, ChaosEffectEntity* out[],
+        bool share_weight);
+    size_t pick_effects(ChaosMachine& machine, Disturbance disturbance, size_t count,
+        ChaosEffectEntity* out[], bool share_weight);
+    void commit_pick(ChaosEffectEntity& entity);
+
     size_t get_machine_count();
     u32 get_total_effect_count();
 
-    void activate_subgroups(const std::unordered_set<Tag::combo_id>& subgroups);
-    void deactivate_subgroups(const std::unordered_set<Tag::combo_id>& subgroups);
+    void build_subgroup_index();
+    void activate_subgroups(const Tag::combo_set& subgroups);
+    void deactivate_subgroups(const Tag::combo_set& subgroups);
+    void release_waiting_effects(Tag::combo_id combo);
+    void wake_waiting_effects();
 
     void queue_pause_fun(ChaosEffect* effect);
     void queue_unpause_fun(ChaosEffect* effect);
@@ -1,5 +1,8 @@
 #include "chaos.h"
 
+#include <algorithm>
+#include <cstring>
+
 namespace Chaos {
     extern GameCtx* _ctx;
 
@@ -25,6 +28,31 @@ namespace Chaos {
         debug_log("Effect '%s' ended.", effect.name);
     }
 
+    static inline void instance_start(ChaosEffect& effect, const ChaosInstanceSettings& settings,
+            u32 instance, void* state, GameCtx* ctx) {
+        if (settings.on_start_fun != nullptr) {
+            settings.on_start_fun(ctx, instance, state);
+        }
+
+        debug_log("Effect '%s' instance %u started.", effect.name, instance);
+    }
+
+    static inline void instance_update(const ChaosInstanceSettings& settings,
+            u32 instance, void* state, GameCtx* ctx) {
+        if (settings.update_fun != nullptr) {
+            settings.update_fun(ctx, instance, state);
+        }
+    }
+
+    static inline void instance_end(ChaosEffect& effect, const ChaosInstanceSettings& settings,
+            u32 instance, void* state, GameCtx* ctx) {
+        if (settings.on_end_fun != nullptr) {
+            settings.on_end_fun(ctx, instance, state);
+        }
+
+        debug_log("Effect '%s' instance %u ended.", effect.name, instance);
+    }
+
     static inline void effect_pause(ChaosEffect& effect, GameCtx* ctx) {
         if (effect.on_pause_fun != nullptr) {
             queue_pause_fun(&effect);
@@ -41,91 +69,213 @@ namespace Chaos {
         debug_log("Effect '%s' unpaused.", effect.name);
     }
 
-    void ActiveChaosEffectList::queue_for_remove_entity(ChaosEffectEntity& entity) {
-        Node* prev = nullptr;
+    // Called while effects are registered, before the pool is allocated.
+    u32 ActiveChaosEffectList::add_instance_block(const ChaosInstanceSettings& settings) {
+        InstanceBlock block;
+        block.settings = settings;
+        block.first_instance = instance_count;
+        block.state_offset = state_word_count;
+        block.state_stride = (settings.state_size + sizeof(u64) - 1) / sizeof(u64);
+        block.free_count = settings.max_instances;
+
+        instance_count += settings.max_instances;
+        state_word_count += block.state_stride * settings.max_instances;
+        max_state_stride = std::max(max_state_stride, block.state_stride);
+
+        instance_blocks.push_back(block);
+        return instance_blocks.size() - 1;
+    }
+
+    void ActiveChaosEffectList::alloc(u32 capacity) {
+        // Every instance past the first one of its effect needs a node of its own.
+        for (const InstanceBlock& block : instance_blocks) {
+            capacity += block.settings.max_instances - 1;
+        }
+
+        instance_states = std::make_unique<u64[]>(state_word_count);
+        free_instances = std::make_unique<u32[]>(instance_count);
+        instance_nodes = std::make_unique<u32[]>(instance_count);
+        ending_state = std::make_unique<u64[]>(max_state_stride);
+        for (u32 i = 0; i < instance_count; i++) {
+            free_instances[i] = i;
+            instance_nodes[i] = NO_ACTIVE_NODE;
+        }
+
+        nodes = std::make_unique<Node[]>(capacity);
+        update_entries = std::make_unique<UpdateEntry[]>(capacity);
+        expired_nodes = std::make_unique<u32[]>(capacity);
+        this->capacity = capacity;
+        update_count = 0;
 
-        for (Node* cur = root.get(); cur != nullptr; cur = cur->next.get()) {
-            if (cur->effect == &entity) {
-                move_node(root, remove_root, prev);
-                break;
+        frame = 0;
+        deadlines.alloc(capacity, frame);
+
+        for (u32 i = 0; i < LIST_COUNT; i++) {
+            heads[i] = NO_ACTIVE_NODE;
+        }
+
+        for (u32 i = 0; i < List::REMOVED; i++) {
+            combo_heads[i].assign(Tag::get_combo_count(), NO_ACTIVE_NODE);
+        }
+
+        for (u32 i = capacity; i > 0; i--) {
+            nodes[i - 1].update_slot = NO_ACTIVE_NODE;
+            link(i - 1, List::FREE);
+        }
+    }
+
+    void ActiveChaosEffectList::queue_for_remove_entity(ChaosEffectEntity& entity) {
+        if (entity.instance_block != NO_INSTANCE_BLOCK) {
+            const InstanceBlock& block = instance_blocks[entity.instance_block];
+            u32 end = block.first_instance + block.settings.max_instances;
+            for (u32 i = block.first_instance; i < end; i++) {
+                u32 node = instance_nodes[i];
+                if ((node != NO_ACTIVE_NODE) && (nodes[node].list == List::RUNNING)) {
+                    move_node(node, List::REMOVED);
+                }
             }
+            return;
+        }
 
-            prev = cur;
+        u32 node = entity.active_node;
+        if ((node != NO_ACTIVE_NODE) && (nodes[node].list == List::RUNNING)) {
+            move_node(node, List::REMOVED);
         }
     }
 
     void ActiveChaosEffectList::add(ChaosGroup& group, ChaosEffectEntity& entity) {
-        std::unique_ptr<Node> n = std::make_unique<Node>();
+        // Effects activated during their cooldown end it early, freeing its node.
+        u32 cooling = entity.active_node;
+        if ((entity.status == ChaosEffectStatus::HIDDEN) && (cooling != NO_ACTIVE_NODE)
+                && (nodes[cooling].list == List::COOLING)) {
+            // Its deadline is already taken out if it expires in this update.
+            if (deadlines.contains(cooling)) {
+                deadlines.remove(cooling);
+            }
+            entity.active_node = NO_ACTIVE_NODE;
+            move_node(cooling, List::FREE);
+        }
 
-        n->effect = &entity;
-        n->group = &group;
-        n->timer = 0;
-        n->next = std::move(root);
-        root = std::move(n);
+        u32 n = heads[List::FREE];
+        if (n == NO_ACTIVE_NODE) {
+            error("Can't activate '%s' effect, all %u active effect slots are in use!",
+                entity.effect.name, capacity);
+            return;
+        }
 
-        if (entity.status == ChaosEffectStatus::AVAILABLE) {
+        u32 instance = NO_INSTANCE;
+        bool is_full = false;
+        if (entity.instance_block != NO_INSTANCE_BLOCK) {
+            instance = take_instance(entity);
+            if (instance == NO_INSTANCE) {
+                error("Can't activate '%s' effect, all of its %u instances are running!",
+                    entity.effect.name, instance_blocks[entity.instance_block].settings.max_instances);
+                return;
+            }
+
+            instance_nodes[instance] = n;
+            is_full = (instance_blocks[entity.instance_block].free_count == 0);
+        }
+
+        unlink(n);
+        // A node freed during the sweep still parks its update slot until it's compacted.
+        if (nodes[n].update_slot != NO_ACTIVE_NODE) {
+            update_entries[nodes[n].update_slot].is_pending = true;
+        }
+
+        nodes[n].effect = &entity;
+        nodes[n].group = &group;
+        nodes[n].timer = 0;
+        nodes[n].instance = instance;
+        link(n, List::RUNNING);
+        entity.active_node = n;
+
+        if ((entity.status == ChaosEffectStatus::AVAILABLE)
+                || (entity.status == ChaosEffectStatus::HIDDEN)) {
             group.set_effect_status(entity, ChaosEffectStatus::ACTIVE);
         }
 
-        ChaosEffect& effect = entity.effect;
-        effect_start(effect, _ctx);
+        // Instanced effects can be rolled again until their stack is full.
+        if ((instance != NO_INSTANCE) && (entity.status == ChaosEffectStatus::ACTIVE)) {
+            group.set_effect_rollable(entity, !is_full);
+        }
+
+        start_node(n);
     }
 
 
+    // Effects started during the sweep are first updated in the next frame.
     void ActiveChaosEffectList::update() {
-        Node* prev = nullptr;
+        u32 count = update_count;
 
-        for (Node* cur = root.get(); cur != nullptr; cur = cur->next.get()) {
-            ChaosEffectEntity& entity = *cur->effect;
-            ChaosEffect& effect = entity.effect;
+        is_sweeping = true;
+        for (u32 i = 0; i < count; i++) {
+            UpdateEntry& entry = update_entries[i];
+            if (entry.is_removed || entry.is_pending) {
+                continue;
+            }
 
-            effect_update(effect, _ctx);
+            if (entry.update_fun != nullptr) {
+                entry.update_fun(_ctx);
+            } else {
+                entry.instance_update_fun(_ctx, entry.instance, entry.state);
+            }
+        }
+        is_sweeping = false;
 
-            if (cur->timer >= effect.duration) {
-                remove_after(prev);
+        if (has_removed_updates) {
+            compact_updates();
+        }
+
+        // Expired nodes are collected first, as ending effects can move other nodes.
+        u32 expired_count = deadlines.advance(expired_nodes.get());
+        frame++;
+
+        for (u32 i = 0; i < expired_count; i++) {
+            u32 node = expired_nodes[i];
+            if (deadlines.contains(node)) {
                 continue;
             }
-            cur->timer++;
 
-            prev = cur;
+            if (nodes[node].list == List::RUNNING) {
+                remove(node);
+            } else if (nodes[node].list == List::COOLING) {
+                finish_cooldown(node);
+            }
         }
     }
 
     void ActiveChaosEffectList::empty_remove_queue() {
-        std::unique_ptr<Node> cur = std::move(remove_root);
-        while (cur.get() != nullptr) {
-            ChaosEffectEntity& entity = *cur->effect;
-            ChaosEffect& effect = entity.effect;
+        while (heads[List::REMOVED] != NO_ACTIVE_NODE) {
+            u32 cur = heads[List::REMOVED];
 
-            effect_update(effect, _ctx);
-            effect_end(effect, _ctx);
+            // Stopped effects release their reservations like expired ones.
+            release(cur);
 
-            std::unique_ptr<Node> tmp = std::move(cur);
-            cur = std::move(tmp->next);
+            update_node(cur);
+            end_node(cur);
         }
-
-        remove_root = nullptr;
     }
 
-    void ActiveChaosEffectList::pause_effects(const std::unordered_set<Tag::combo_id>& affected_combos) {
-        Node* prev_start = pause_root.get();
+    void ActiveChaosEffectList::pause_effects(const Tag::combo_set& affected_combos) {
+        u32 prev_start = heads[List::PAUSED];
 
-        move_nodes(root, pause_root, affected_combos);
+        move_nodes(List::RUNNING, List::PAUSED, affected_combos);
 
-        for (Node* cur = pause_root.get(); cur != prev_start; cur = cur->next.get()) {
-            ChaosEffectEntity& entity = *cur->effect;
+        for (u32 cur = heads[List::PAUSED]; cur != prev_start; cur = nodes[cur].next) {
+            ChaosEffectEntity& entity = *nodes[cur].effect;
             ChaosEffect& effect = entity.effect;
             effect_pause(effect, _ctx);
         }
     }
 
-    void ActiveChaosEffectList::unpause_effects(const std::unordered_set<Tag::combo_id>& affected_combos) {
-        Node* prev_start = root.get();
+    void ActiveChaosEffectList::unpause_effects(const Tag::combo_set& affected_combos) {
+        u32 prev_start = heads[List::RUNNING];
 
-        move_nodes(pause_root, root, affected_combos);
+        move_nodes(List::PAUSED, List::RUNNING, affected_combos);
 
-        for (Node* cur = root.get(); cur != prev_start; cur = cur->next.get()) {
-            ChaosEffectEntity& entity = *cur->effect;
+        for (u32 cur = heads[List::RUNNING]; cur != prev_start; cur = nodes[cur].next) {
+            ChaosEffectEntity& entity = *nodes[cur].effect;
             ChaosEffect& effect = entity.effect;
             effect_unpause(effect, _ctx);
         }
@@ -133,70 +283,336 @@ namespace Chaos {
 
 
     u32 ActiveChaosEffectList::get_timer(const ChaosEffectEntity& effect) const {
-        for (Node* cur : {root.get(), pause_root.get()}) {
-            while (cur != nullptr) {
-                if (cur->effect == &effect) {
-                    return cur->timer;
-                }
-                cur = cur->next.get();
-            }
+        u32 node = effect.active_node;
+        if (node == NO_ACTIVE_NODE) {
+            return 0;
+        }
+
+        switch (nodes[node].list) {
+            case List::RUNNING:
+                return frame - nodes[node].start_frame;
+            case List::PAUSED:
+                return nodes[node].timer;
+            default:
+                return 0;
         }
-        return 0;
     }
 
+    u32 ActiveChaosEffectList::get_instance_count(const ChaosEffectEntity& effect) const {
+        if (effect.instance_block == NO_INSTANCE_BLOCK) {
+            return (effect.status == ChaosEffectStatus::ACTIVE) ? 1 : 0;
+        }
 
-    void ActiveChaosEffectList::move_node(
-            std::unique_ptr<Node>& from_root, std::unique_ptr<Node>& to_root, Node* element) {
+        const InstanceBlock& block = instance_blocks[effect.instance_block];
+        return block.settings.max_instances - block.free_count;
+    }
 
-        std::unique_ptr<Node> moved;
-        if (element == nullptr) {
-            moved = std::move(from_root);
-            from_root = std::move(moved->next);
-        } else {
-            moved = std::move(element->next);
-            element->next = std::move(moved->next);
+    // Only running instances have a state.
+    void* ActiveChaosEffectList::get_instance_state(
+            const ChaosEffectEntity& effect, u32 instance) const {
+        if (effect.instance_block == NO_INSTANCE_BLOCK) {
+            return nullptr;
+        }
+
+        const InstanceBlock& block = instance_blocks[effect.instance_block];
+        if (instance >= block.settings.max_instances) {
+            return nullptr;
         }
 
-        moved->next = std::move(to_root);
-        to_root = std::move(moved);
+        instance += block.first_instance;
+        if (instance_nodes[instance] == NO_ACTIVE_NODE) {
+            return nullptr;
+        }
+        return get_state(block, instance);
     }
 
-    void ActiveChaosEffectList::move_nodes(
-            std::unique_ptr<Node>& from_root,
-            std::unique_ptr<Node>& to_root,
-            const std::unordered_set<Tag::combo_id>& affected_combos) {
 
-        Node* prev = nullptr;
+    void* ActiveChaosEffectList::get_state(const InstanceBlock& block, u32 instance) const {
+        u32 offset = block.state_offset + (instance - block.first_instance) * block.state_stride;
+        return &instance_states[offset];
+    }
+
+    u32 ActiveChaosEffectList::take_instance(ChaosEffectEntity& entity) {
+        InstanceBlock& block = instance_blocks[entity.instance_block];
+        if (block.free_count == 0) {
+            return NO_INSTANCE;
+        }
+
+        block.free_count--;
+        u32 instance = free_instances[block.first_instance + block.free_count];
+        std::memset(get_state(block, instance), 0, block.state_stride * sizeof(u64));
+        return instance;
+    }
+
+    void ActiveChaosEffectList::free_instance(ChaosEffectEntity& entity, u32 instance) {
+        InstanceBlock& block = instance_blocks[entity.instance_block];
+        free_instances[block.first_instance + block.free_count] = instance;
+        block.free_count++;
+        instance_nodes[instance] = NO_ACTIVE_NODE;
+    }
+
+    void ActiveChaosEffectList::start_node(u32 node) {
+        ChaosEffectEntity& entity = *nodes[node].effect;
+        u32 instance = nodes[node].instance;
+        if (instance == NO_INSTANCE) {
+            effect_start(entity.effect, _ctx);
+            return;
+        }
+
+        const InstanceBlock& block = instance_blocks[entity.instance_block];
+        instance_start(entity.effect, block.settings,
+            instance - block.first_instance, get_state(block, instance), _ctx);
+    }
+
+    void ActiveChaosEffectList::update_node(u32 node) {
+        ChaosEffectEntity& entity = *nodes[node].effect;
+        u32 instance = nodes[node].instance;
+        if (instance == NO_INSTANCE) {
+            effect_update(entity.effect, _ctx);
+            return;
+        }
+
+        const InstanceBlock& block = instance_blocks[entity.instance_block];
+        instance_update(block.settings,
+            instance - block.first_instance, get_state(block, instance), _ctx);
+    }
+
+    // The node is already free, so the instance is freed before its end callback too,
+    // as the callback can start effects on both. It gets a copy of the state instead.
+    void ActiveChaosEffectList::end_node(u32 node) {
+        ChaosEffectEntity& entity = *nodes[node].effect;
+        u32 instance = nodes[node].instance;
+        if (instance == NO_INSTANCE) {
+            effect_end(entity.effect, _ctx);
+            return;
+        }
+
+        const InstanceBlock& block = instance_blocks[entity.instance_block];
+        std::memcpy(ending_state.get(), get_state(block, instance), block.state_stride * sizeof(u64));
+
+        nodes[node].instance = NO_INSTANCE;
+        free_instance(entity, instance);
+
+        instance_end(entity.effect, block.settings,
+            instance - block.first_instance, ending_state.get(), _ctx);
+    }
+
+
+    void ActiveChaosEffectList::add_update(u32 node) {
+        Node& n = nodes[node];
+        UpdateEntry entry = { n.effect->effect.update_fun, nullptr, nullptr, 0, node, false, false };
+        if (n.instance != NO_INSTANCE) {
+            const InstanceBlock& block = instance_blocks[n.effect->instance_block];
+            entry.update_fun = nullptr;
+            entry.instance_update_fun = block.settings.update_fun;
+            entry.state = get_state(block, n.instance);
+            entry.instance = n.instance - block.first_instance;
+        }
+
+        if ((entry.update_fun == nullptr) && (entry.instance_update_fun == nullptr)) {
+            n.update_slot = NO_ACTIVE_NODE;
+            return;
+        }
+
+        if (n.update_slot != NO_ACTIVE_NODE) {
+            entry.is_pending = update_entries[n.update_slot].is_pending;
+            update_entries[n.update_slot] = entry;
+            return;
+        }
+
+        update_entries[update_count] = entry;
+        nodes[node].update_slot = update_count;
+        update_count++;
+    }
+
+    void ActiveChaosEffectList::remove_update(u32 node) {
+        u32 slot = nodes[node].update_slot;
+        if ((slot == NO_ACTIVE_NODE) || update_entries[slot].is_removed) {
+            return;
+        }
+
+        if (is_sweeping) {
+            update_entries[slot].is_removed = true;
+            has_removed_updates = true;
+            return;
+        }
+        nodes[node].update_slot = NO_ACTIVE_NODE;
+
+        update_count--;
+        if (slot != update_count) {
+            update_entries[slot] = update_entries[update_count];
+            nodes[update_entries[slot].node].update_slot = slot;
+        }
+    }
 
-        for (Node* cur = from_root.get(); cur != nullptr; cur = cur->next.get()) {
-            Tag::combo_id combo = cur->effect->combo;
-            if (affected_combos.contains(combo)) {
-                move_node(from_root, to_root, prev);
+    void ActiveChaosEffectList::compact_updates() {
+        u32 count = 0;
+        for (u32 i = 0; i < update_count; i++) {
+            UpdateEntry& entry = update_entries[i];
+            if (entry.is_removed) {
+                nodes[entry.node].update_slot = NO_ACTIVE_NODE;
+            } else {
+                nodes[entry.node].update_slot = count;
+                entry.is_pending = false;
+                update_entries[count] = entry;
+                count++;
             }
+        }
+
+        update_count = count;
+        has_removed_updates = false;
+    }
 
-            prev = cur;
+    // Combos created after the initialization are only added on demand.
+    u32& ActiveChaosEffectList::get_combo_head(List list, Tag::combo_id combo) {
+        std::vector<u32>& list_heads = combo_heads[list];
+        if (static_cast<size_t>(combo) >= list_heads.size()) {
+            list_heads.resize(combo + 1, NO_ACTIVE_NODE);
         }
+        return list_heads[combo];
     }
 
-    void ActiveChaosEffectList::remove_after(Node* element) {
-        std::unique_ptr<Node> del;
+    // Nodes are linked at the head, so that recently moved nodes come first.
+    void ActiveChaosEffectList::link(u32 node, List list) {
+        Node& n = nodes[node];
+        n.list = list;
+        n.prev = NO_ACTIVE_NODE;
+        n.next = heads[list];
+        if (n.next != NO_ACTIVE_NODE) {
+            nodes[n.next].prev = node;
+        }
+        heads[list] = node;
+
+        if (list < List::REMOVED) {
+            u32& combo_head = get_combo_head(list, n.effect->combo);
+            n.combo_prev = NO_ACTIVE_NODE;
+            n.combo_next = combo_head;
+            if (n.combo_next != NO_ACTIVE_NODE) {
+                nodes[n.combo_next].combo_prev = node;
+            }
+            combo_head = node;
+        }
 
-        if (element == nullptr) {
-            del = std::move(root);
-            root = std::move(del->next);
+        if (list == List::RUNNING) {
+            add_update(node);
+
+            // An effect is removed in the update in which its timer reaches the duration.
+            n.start_frame = frame - n.timer;
+            deadlines.insert(node, n.start_frame + n.effect->effect.duration);
+        }
+    }
+
+    void ActiveChaosEffectList::unlink(u32 node) {
+        Node& n = nodes[node];
+        if (n.prev != NO_ACTIVE_NODE) {
+            nodes[n.prev].next = n.next;
         } else {
-            del = std::move(element->next);
-            element->next = std::move(del->next);
+            heads[n.list] = n.next;
         }
 
-        ChaosEffectEntity& entity = *del->effect;
-        ChaosEffect& effect = entity.effect;
+        if (n.next != NO_ACTIVE_NODE) {
+            nodes[n.next].prev = n.prev;
+        }
 
+        if (n.list < List::REMOVED) {
+            if (n.combo_prev != NO_ACTIVE_NODE) {
+                nodes[n.combo_prev].combo_next = n.combo_next;
+            } else {
+                get_combo_head(n.list, n.effect->combo) = n.combo_next;
+            }
+
+            if (n.combo_next != NO_ACTIVE_NODE) {
+                nodes[n.combo_next].combo_prev = n.combo_prev;
+            }
+        }
+
+        if (n.list == List::RUNNING) {
+            remove_update(node);
+
+            n.timer = frame - n.start_frame;
+            if (deadlines.contains(node)) {
+                deadlines.remove(node);
+            }
+        }
+    }
+
+    void ActiveChaosEffectList::move_node(u32 node, List list) {
+        unlink(node);
+        link(node, list);
+    }
+
+    void ActiveChaosEffectList::move_nodes(
+            List from, List to, const Tag::combo_set& affected_combos) {
+        std::vector<u32>& from_heads = combo_heads[from];
+        for (Tag::combo_id combo : affected_combos) {
+            if (static_cast<size_t>(combo) >= from_heads.size()) {
+                continue;
+            }
+
+            for (u32 cur = from_heads[combo]; cur != NO_ACTIVE_NODE; ) {
+                u32 next = nodes[cur].combo_next;
+                move_node(cur, to);
+                cur = next;
+            }
+        }
+    }
+
+    void ActiveChaosEffectList::remove(u32 node) {
+        release(node);
+        end_node(node);
+    }
+
+    // Returns the effect to AVAILABLE, unless it has a cooldown. Then the node
+    // waits in the wheel until the effect has been HIDDEN for the cooldown frames.
+    void ActiveChaosEffectList::release(u32 node) {
+        ChaosEffectEntity& entity = *nodes[node].effect;
+
+        // Instanced effects keep their status until the last instance ends.
+        if ((nodes[node].instance != NO_INSTANCE) && (get_instance_count(entity) > 1)) {
+            if (entity.status == ChaosEffectStatus::ACTIVE) {
+                ChaosGroup& group = *nodes[node].group;
+                group.set_effect_rollable(entity, true);
+            }
+
+            if (entity.active_node == node) {
+                entity.active_node = NO_ACTIVE_NODE;
+            }
+            move_node(node, List::FREE);
+            return;
+        }
+
+        bool cools_down = false;
         if (entity.status == ChaosEffectStatus::ACTIVE) {
-            ChaosGroup& group = *del->group;
+            cools_down = (entity.cooldown > 0);
+
+            ChaosGroup& group = *nodes[node].group;
+            group.set_effect_status(entity,
+                cools_down ? ChaosEffectStatus::HIDDEN : ChaosEffectStatus::AVAILABLE);
+        }
+
+        if (cools_down) {
+            move_node(node, List::COOLING);
+            deadlines.insert(node, frame + entity.cooldown - 1);
+            return;
+        }
+
+        if (entity.active_node == node) {
+            entity.active_node = NO_ACTIVE_NODE;
+        }
+        move_node(node, List::FREE);
+    }
+
+    void ActiveChaosEffectList::finish_cooldown(u32 node) {
+        ChaosEffectEntity& entity = *nodes[node].effect;
+
+        if (entity.status == ChaosEffectStatus::HIDDEN) {
+            ChaosGroup& group = *nodes[node].group;
             group.set_effect_status(entity, ChaosEffectStatus::AVAILABLE);
         }
 
-        effect_end(effect, _ctx);
+        if (entity.active_node == node) {
+            entity.active_node = NO_ACTIVE_NODE;
+        }
+        move_node(node, List::FREE);
     }
-}
\ No newline at end of file
+}
@@ -15,6 +15,22 @@ typedef struct {
     ChaosFunction on_end_fun;
 } ChaosEffect;
 
+// Instanced effects can run several times at once. Every activation gets its own
+// instance, numbered from 0, and a zeroed state block of state_size bytes from a pool
+// allocated at initialization. They start, update and end through these callbacks
+// instead of the ones of their ChaosEffect. The end callback gets a copy of the state,
+// as the instance is already free then and may be started again from the callback.
+typedef void (*ChaosInstanceFunction)(PlayState* play, u32 instance, void* state);
+
+typedef struct {
+    u32 max_instances;
+    u32 state_size; // In bytes.
+
+    ChaosInstanceFunction on_start_fun;
+    ChaosInstanceFunction update_fun;
+    ChaosInstanceFunction on_end_fun;
+} ChaosInstanceSettings;
+
 typedef void ChaosEffectEntity;
 
 typedef enum {
@@ -27,20 +43,35 @@ typedef enum {
     CHAOS_DISTURBANCE_MAX,
 } ChaosDisturbance;
 
+// The alias sampler draws in constant expected time while most effects are available,
+// but is rebuilt in linear time after any weight change. A winner weight share changes
+// the weights on every roll, so only use it for groups with no winner weight share.
+typedef enum {
+    CHAOS_SAMPLER_TREE,
+    CHAOS_SAMPLER_ALIAS,
+} ChaosSamplerBackend;
+
 typedef struct {
     f32 initial_probability;
     f32 on_pick_multiplier;
     f32 winner_weight_share;
+    ChaosSamplerBackend sampler;
 } ChaosGroupSettings;
 
 typedef struct {
     char* name;
     u32 cycle_length; // In frames.
     ChaosGroupSettings default_groups_settings[CHAOS_DISTURBANCE_MAX];
+    bool unified_roll; // One random number picks both the group and the effect.
 } ChaosMachineSettings;
 
 typedef void ChaosMachine;
 
+// Valid for the whole run once obtained. Built-in tags have the constant
+// CHAOS_TAG_HANDLE_* handles from tag_names.h. Names of tags that were never
+// registered nor used by an effect give -1, which the tag functions reject.
+typedef s32 ChaosTagHandle;
+
 RECOMP_IMPORT("mm_recomp_chaos_framework",
     ChaosEffectEntity* chaos_register_effect_to(
         ChaosMachine* machine, const ChaosEffect* effect, ChaosDisturbance disturbance,
@@ -50,6 +81,18 @@ RECOMP_IMPORT("mm_recomp_chaos_framework",
         const ChaosEffect* effect, ChaosDisturbance disturbance,
         const char* tag_names[], size_t tag_count))
 
+// An instanced effect holds its tags from the start of its first instance to the end of its
+// last one, and its cooldown starts after the last one. It can be rolled again while some of
+// its instances are free and its own tags don't block it.
+RECOMP_IMPORT("mm_recomp_chaos_framework",
+    ChaosEffectEntity* chaos_register_instanced_effect_to(
+        ChaosMachine* machine, const ChaosEffect* effect, ChaosDisturbance disturbance,
+        const char* tag_names[], size_t tag_count, const ChaosInstanceSettings* settings))
+RECOMP_IMPORT("mm_recomp_chaos_framework",
+    ChaosEffectEntity* chaos_register_instanced_effect(
+        const ChaosEffect* effect, ChaosDisturbance disturbance,
+        const char* tag_names[], size_t tag_count, const ChaosInstanceSettings* settings))
+
 RECOMP_IMPORT("mm_recomp_chaos_framework",
     ChaosMachine* chaos_register_machine(const ChaosMachineSettings* settings))
 
@@ -57,8 +100,54 @@ RECOMP_IMPORT("mm_recomp_chaos_framework",void chaos_enable_effect(ChaosEffectEn
 RECOMP_IMPORT("mm_recomp_chaos_framework", void chaos_disable_effect(ChaosEffectEntity* entity))
 RECOMP_IMPORT("mm_recomp_chaos_framework", void chaos_stop_effect(ChaosEffectEntity* entity))
 
+// Starts the effect right away, or once the tags blocking it are released.
+// Waiting effects start in request order. Stopping the effect cancels the wait.
+RECOMP_IMPORT("mm_recomp_chaos_framework", void chaos_queue_effect(ChaosEffectEntity* entity))
+
+// Frames the effect has been running for, 0 if it isn't active.
+RECOMP_IMPORT("mm_recomp_chaos_framework", u32 chaos_get_effect_timer(ChaosEffectEntity* entity))
+
+// After ending, the effect can't be rolled for the given number of frames.
+RECOMP_IMPORT("mm_recomp_chaos_framework",
+    void chaos_set_effect_cooldown(ChaosEffectEntity* entity, u32 cooldown))
+
+// Number of running instances. Stopping an instanced effect stops all of them.
+RECOMP_IMPORT("mm_recomp_chaos_framework",
+    u32 chaos_get_effect_instance_count(ChaosEffectEntity* entity))
+// State of a running instance, NULL if the instance isn't running.
+RECOMP_IMPORT("mm_recomp_chaos_framework",
+    void* chaos_get_effect_instance_state(ChaosEffectEntity* entity, u32 instance))
+
 RECOMP_IMPORT("mm_recomp_chaos_framework", void chaos_request_roll(ChaosMachine* machine))
 RECOMP_IMPORT("mm_recomp_chaos_framework",
     void chaos_request_group_roll(ChaosMachine* machine, ChaosDisturbance disturbance))
 
+// Draws up to count distinct effects without activating them. With share_weight set to false
+// the weights are left untouched until the chosen effect is passed to chaos_commit_pick.
+RECOMP_IMPORT("mm_recomp_chaos_framework",
+    u32 chaos_pick_effects(
+        ChaosMachine* machine, u32 count, ChaosEffectEntity* out[], bool share_weight))
+RECOMP_IMPORT("mm_recomp_chaos_framework",
+    u32 chaos_pick_group_effects(ChaosMachine* machine, ChaosDisturbance disturbance,
+        u32 count, ChaosEffectEntity* out[], bool share_weight))
+RECOMP_IMPORT("mm_recomp_chaos_framework", void chaos_commit_pick(ChaosEffectEntity* entity))
+
+// Every machine rolls with its own generator. Setting a seed restarts its sequence,
+// so the same seed and the same requests replay the same rolls.
+RECOMP_IMPORT("mm_recomp_chaos_framework", u32 chaos_get_machine_seed(ChaosMachine* machine))
+RECOMP_IMPORT("mm_recomp_chaos_framework",
+    void chaos_set_machine_seed(ChaosMachine* machine, u32 seed))
+
+// Handles skip the name lookup, which matters for tags toggled every few frames.
+RECOMP_IMPORT("mm_recomp_chaos_framework", void chaos_forbid_tag(const char* tag))
+RECOMP_IMPORT("mm_recomp_chaos_framework", void chaos_allow_tag(const char* tag))
+RECOMP_IMPORT("mm_recomp_chaos_framework", ChaosTagHandle chaos_get_tag_handle(const char* tag))
+RECOMP_IMPORT("mm_recomp_chaos_framework", void chaos_forbid_tag_handle(ChaosTagHandle handle))
+RECOMP_IMPORT("mm_recomp_chaos_framework", void chaos_allow_tag_handle(ChaosTagHandle handle))
+RECOMP_IMPORT("mm_recomp_chaos_framework", bool chaos_is_tag_forbidden(ChaosTagHandle handle))
+
+// While batching, tag changes take effect together at the next chaos update and
+// a tag forbidden and allowed again in between has no effect at all.
+RECOMP_IMPORT("mm_recomp_chaos_framework", void chaos_set_tag_batching(bool enabled))
+
 #endif /* __CHAOS_DEP_H__ */
\ No newline at end of file
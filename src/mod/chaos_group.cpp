@@ -2,405 +2,623 @@
 
 #include <memory>
 #include <cstring>
+#include <bit>
+#include <cmath>
 
 namespace Chaos {
-    double ChaosGroup::EffectSubtree::get_weight(Node& node) const {
-        return node.weight_deviation + owner.shared_weight;
-    }
+    // Reused by status changes, so that starting and ending effects doesn't allocate.
+    Tag::combo_set status_affected_combos;
+
+    // Number of effects moved to the new offset epoch per single pick.
+    constexpr size_t REBASE_STEP_SIZE = 16;
+    // Number of Fenwick nodes recomputed per frame to cancel rounding errors.
+    constexpr size_t REPAIR_STEP_SIZE = 32;
+    // Number of alias draws landing on uncounted effects before a pick falls back to the tree.
+    constexpr int ALIAS_DRAW_LIMIT = 4;
 
-    double ChaosGroup::EffectSubtree::get_left_weight(Node& node) const {
-        return node.left_deviation_sum + node.left_count * owner.shared_weight;
+    template <typename Weight>
+    auto ChaosGroup::BasicEffectTree<Weight>::get_offset(u8 node_epoch) const -> Value {
+        return (shared_weight - epoch_bases[node_epoch]) + shared_weight_error;
     }
 
+    template <typename Weight>
+    auto ChaosGroup::BasicEffectTree<Weight>::get_offset_weight(
+            u32 node_count, u32 node_odd_count) const -> Value {
+        return (node_count - node_odd_count) * get_offset(0) + node_odd_count * get_offset(1);
+    }
 
-    size_t ChaosGroup::EffectSubtree::reserve_slot() {
-        return _size++;
+    template <typename Weight>
+    auto ChaosGroup::BasicEffectTree<Weight>::get_fenwick_weight(size_t pos) const -> Value {
+        return fenwick_deviations[pos]
+            + get_offset_weight(fenwick_counts[pos], fenwick_odd_counts[pos]);
     }
 
-    void ChaosGroup::EffectSubtree::reset_size() {
-        _size = 0;
+    template <typename Weight>
+    auto ChaosGroup::BasicEffectTree<Weight>::get_weight(u32 effect) const -> Value {
+        return deviations[effect] + get_offset(epochs[effect]);
     }
 
-    void ChaosGroup::EffectSubtree::alloc_nodes() {
-        nodes = std::make_unique<Node[]>(_size);
+    template <typename Weight>
+    auto ChaosGroup::BasicEffectTree<Weight>::get_weight_sum() const -> Value {
+        return deviation_sum + get_offset_weight(count, odd_count);
     }
 
 
-    bool ChaosGroup::EffectSubtree::is_counted(Node& node) const {
-        return (node.effect.status == ChaosEffectStatus::AVAILABLE);
+    template <typename Weight>
+    size_t ChaosGroup::BasicEffectTree<Weight>::reserve_slot(Tag::combo_id combo) {
+        total_effect_count++;
+        if (static_cast<size_t>(combo) >= subgroup_indices.size()) {
+            subgroup_indices.resize(combo + 1, NO_SUBGROUP);
+        }
+
+        u32& index = subgroup_indices[combo];
+        if (index == NO_SUBGROUP) {
+            index = subgroups.size();
+            subgroups.push_back({ .combo = combo });
+        }
+        return subgroups[index].size++;
     }
 
-    double ChaosGroup::EffectSubtree::get_deviation(Node& node) const {
-        if (is_counted(node)) {
-            return node.weight_deviation;
+    template <typename Weight>
+    void ChaosGroup::BasicEffectTree<Weight>::reset_size() {
+        total_effect_count = 0;
+        for (Subgroup& subgroup : subgroups) {
+            subgroup.size = 0;
         }
-        return 0.0;
     }
 
-    void ChaosGroup::EffectSubtree::init_tree() {
-        for (size_t i = _size; i > 0; i--) {
-            Node& node = nodes[i - 1];
+    template <typename Weight>
+    void ChaosGroup::BasicEffectTree<Weight>::alloc_nodes() {
+        u32 offset = 0;
+        for (Subgroup& subgroup : subgroups) {
+            subgroup.offset = offset;
+            offset += subgroup.size;
+        }
 
-            double deviation = get_deviation(node);
-            size_t c = is_counted(node) ? 1 : 0;
+        size_t effect_count = total_effect_count;
+        size_t fenwick_size = subgroups.size() + effect_count;
 
-            bool last_child_left = (i % 2 == 0);
+        size_t bytes = (fenwick_size + effect_count) * sizeof(Value)
+            + 2 * fenwick_size * sizeof(u32)
+            + effect_count * (sizeof(u8) + sizeof(bool));
+        storage = std::make_unique<u64[]>((bytes + sizeof(u64) - 1) / sizeof(u64));
 
-            for (size_t j = i / 2; j > 0; j /= 2) {
-                Node& parent = nodes[j - 1];
+        u8* ptr = reinterpret_cast<u8*>(storage.get());
+        fenwick_deviations = reinterpret_cast<Value*>(ptr);
+        ptr += fenwick_size * sizeof(Value);
+        deviations = reinterpret_cast<Value*>(ptr);
+        ptr += effect_count * sizeof(Value);
+        fenwick_counts = reinterpret_cast<u32*>(ptr);
+        ptr += fenwick_size * sizeof(u32);
+        fenwick_odd_counts = reinterpret_cast<u32*>(ptr);
+        ptr += fenwick_size * sizeof(u32);
+        epochs = ptr;
+        ptr += effect_count * sizeof(u8);
+        actives = reinterpret_cast<bool*>(ptr);
 
-                if (last_child_left) {
-                    parent.left_deviation_sum += deviation;
-                    parent.left_count += c;
-                }
-                last_child_left = (j % 2 == 0);
-            }
+        entities = std::make_unique<ChaosEffectEntity[]>(effect_count);
+    }
 
-            deviation_sum += deviation;
-            count += c;
-        }
+
+    template <typename Weight>
+    bool ChaosGroup::BasicEffectTree<Weight>::is_counted(Tag::combo_id combo) const {
+        return Tag::is_combo_allowed(combo);
     }
 
-    void ChaosGroup::EffectSubtree::update_deviations_upwards(Node& node, double delta) {
-        size_t i = get_pos(node) + 1;
+    template <typename Weight>
+    void ChaosGroup::BasicEffectTree<Weight>::init_tree() {
+        size_t subgroup_count = subgroups.size();
 
-        bool last_child_left = (i % 2 == 0);
-        for (size_t j = i / 2; j > 0; j /= 2) {
-            Node& parent = nodes[j - 1];
+        for (u32 effect = 0; effect < total_effect_count; effect++) {
+            actives[effect] = (entities[effect].status == ChaosEffectStatus::AVAILABLE);
+        }
 
-            if (last_child_left) {
-                parent.left_deviation_sum += delta;
-            }
-            last_child_left = (j % 2 == 0);
+        for (size_t s = 0; s < subgroup_count; s++) {
+            Subgroup& subgroup = subgroups[s];
+            subgroup.is_active = is_counted(subgroup.combo);
         }
 
-        deviation_sum += delta;
+        rebuild();
     }
 
-    void ChaosGroup::EffectSubtree::update_count(Node& node, size_t delta) {
-        size_t i = get_pos(node) + 1;
+    // Recomputes all sums from the per effect data in one linear sweep,
+    // the subtrees are built first so that their sums become the top leaves.
+    template <typename Weight>
+    void ChaosGroup::BasicEffectTree<Weight>::rebuild() {
+        size_t subgroup_count = subgroups.size();
 
-        bool last_child_left = (i % 2 == 0);
-        for (size_t j = i / 2; j > 0; j /= 2) {
-            Node& parent = nodes[j - 1];
+        for (size_t s = 0; s < subgroup_count; s++) {
+            Subgroup& subgroup = subgroups[s];
+            size_t base = subgroup_count + subgroup.offset;
 
-            if (last_child_left) {
-                parent.left_count += delta;
-            }
-            last_child_left = (j % 2 == 0);
-        }
+            for (u32 i = 0; i < subgroup.size; i++) {
+                u32 effect = subgroup.offset + i;
+                bool is_active = actives[effect];
 
-        count += delta;
-    }
+                fenwick_deviations[base + i] = is_active ? deviations[effect] : Weight::zero;
+                fenwick_counts[base + i] = is_active;
+                fenwick_odd_counts[base + i] = is_active ? epochs[effect] : 0;
+            }
 
+            fenwick_build(base, subgroup.size);
 
-    ChaosGroup::EffectSubtree::Node& ChaosGroup::EffectSubtree::get_node(double weight) {
-        for (size_t i = 1; i <= _size;) {
-            Node& node = nodes[i - 1];
-            if (get_left_weight(node) >= weight) {
-                i = i * 2;
-            } else if (get_left_weight(node) + get_weight(node) >= weight) {
-                return node;
-            } else {
-                i = i * 2 + 1;
-                weight -= get_left_weight(node) + get_weight(node);
-            }
+            subgroup.deviation_sum = fenwick_sum(base, subgroup.size, &subgroup.count,
+                &subgroup.odd_count);
         }
 
-        // // Shouldn't happen
-        // error("get_effect_entity_by_weight didn't find any node within given weight limit. "
-        //       "Returning first node.");
-        return nodes[0];
-    }
+        for (size_t s = 0; s < subgroup_count; s++) {
+            Subgroup& subgroup = subgroups[s];
+            bool is_active = subgroup.is_active;
 
-    size_t ChaosGroup::EffectSubtree::get_pos(Node& node) {
-        return &node - nodes.get();
-    }
+            fenwick_deviations[s] = is_active ? subgroup.deviation_sum : Weight::zero;
+            fenwick_counts[s] = is_active ? subgroup.count : 0;
+            fenwick_odd_counts[s] = is_active ? subgroup.odd_count : 0;
+        }
 
+        fenwick_build(0, subgroup_count);
 
+        deviation_sum = fenwick_sum(0, subgroup_count, &count, &odd_count);
 
-    size_t ChaosGroup::EffectTree::size() {
-        if (subgroups.size() == 0) {
-            return 0;
-        }
-        return subgroups.size() * 2 - 1;
+        repair_subgroup = 0;
+        repair_pos = 0;
+        revision++;
     }
 
-    double ChaosGroup::EffectTree::get_weight(EffectSubtree::Node& node) const {
-        return node.weight_deviation + shared_weight;
+    // Turns leaf values into a Fenwick tree by pushing every node into its parent.
+    template <typename Weight>
+    void ChaosGroup::BasicEffectTree<Weight>::fenwick_build(size_t base, size_t size) {
+        for (size_t i = 1; i <= size; i++) {
+            size_t parent = i + (i & -i);
+            if (parent <= size) {
+                fenwick_deviations[base + parent - 1] += fenwick_deviations[base + i - 1];
+                fenwick_counts[base + parent - 1] += fenwick_counts[base + i - 1];
+                fenwick_odd_counts[base + parent - 1] += fenwick_odd_counts[base + i - 1];
+            }
+        }
     }
 
-    double ChaosGroup::EffectTree::get_weight_sum() const {
-        return deviation_sum + count * shared_weight;
+    template <typename Weight>
+    auto ChaosGroup::BasicEffectTree<Weight>::fenwick_sum(size_t base, size_t size,
+            u32* count_out, u32* odd_count_out) const -> Value {
+        Value deviation = Weight::zero;
+        u32 node_count = 0;
+        u32 node_odd_count = 0;
+
+        for (size_t i = size; i > 0; i -= i & -i) {
+            deviation += fenwick_deviations[base + i - 1];
+            node_count += fenwick_counts[base + i - 1];
+            node_odd_count += fenwick_odd_counts[base + i - 1];
+        }
+
+        *count_out = node_count;
+        *odd_count_out = node_odd_count;
+        return deviation;
     }
 
-    double ChaosGroup::EffectTree::get_left_weight(Node& node) const {
-        Info& info = node.info;
-        return info.left_deviation_sum + info.left_count * shared_weight;
+    template <typename Weight>
+    void ChaosGroup::BasicEffectTree<Weight>::fenwick_add(size_t base, size_t size, size_t pos,
+            Value delta, u32 count_delta, u32 odd_delta) {
+        for (size_t i = pos + 1; i <= size; i += i & -i) {
+            fenwick_deviations[base + i - 1] += delta;
+            fenwick_counts[base + i - 1] += count_delta;
+            fenwick_odd_counts[base + i - 1] += odd_delta;
+        }
     }
 
+    template <typename Weight>
+    size_t ChaosGroup::BasicEffectTree<Weight>::fenwick_find(
+            size_t base, size_t size, Value weight, Value* local_weight_out) {
+        size_t pos = 0;
 
-    size_t ChaosGroup::EffectTree::reserve_slot(Tag::combo_id combo) {
-        total_effect_count++;
-        auto it = subgroups.find(combo);
-        if (it == subgroups.end()) {
-            auto [it_, res] = subgroups.emplace(combo, *this);
-            it = it_;
+        for (size_t step = std::bit_floor(size); step > 0; step /= 2) {
+            size_t next = pos + step;
+            if (next <= size) {
+                Value next_weight = get_fenwick_weight(base + next - 1);
+                if (next_weight <= weight) {
+                    pos = next;
+                    weight -= next_weight;
+                }
+            }
         }
-        return it->second.subtree.reserve_slot();
-    }
 
-    void ChaosGroup::EffectTree::reset_size() {
-        total_effect_count = 0;
-        for (auto& [combo, subgroup_data] : subgroups) {
-            subgroup_data.subtree.reset_size();
+        if (local_weight_out) {
+            *local_weight_out = weight;
         }
+        return pos;
     }
 
-    void ChaosGroup::EffectTree::alloc_nodes() {
-        nodes = std::make_unique<Node[]>(size());
+    template <typename Weight>
+    void ChaosGroup::BasicEffectTree<Weight>::update_effect(u32 subgroup, u32 effect,
+            Value delta, u32 count_delta, u32 odd_delta) {
+        Subgroup& data = subgroups[subgroup];
 
-        for (auto& [combo, subgroup_data] : subgroups) {
-            subgroup_data.subtree.alloc_nodes();
+        fenwick_add(subgroups.size() + data.offset, data.size, effect - data.offset,
+            delta, count_delta, odd_delta);
+
+        data.deviation_sum += delta;
+        data.count += count_delta;
+        data.odd_count += odd_delta;
+
+        if (data.is_active) {
+            update_subgroup(subgroup, delta, count_delta, odd_delta);
         }
     }
 
+    template <typename Weight>
+    void ChaosGroup::BasicEffectTree<Weight>::update_subgroup(
+            u32 subgroup, Value delta, u32 count_delta, u32 odd_delta) {
+        fenwick_add(0, subgroups.size(), subgroup, delta, count_delta, odd_delta);
 
-    bool ChaosGroup::EffectTree::is_counted(Tag::combo_id combo) const {
-        return Tag::is_combo_allowed(combo);
+        deviation_sum += delta;
+        count += count_delta;
+        odd_count += odd_delta;
     }
 
-    void ChaosGroup::EffectTree::init_tree() {
-        for (auto& [combo, subgroup_data] : subgroups) {
-            subgroup_data.subtree.init_tree();
-        }
 
-        size_t t_size = size();
-        size_t combo_count = subgroups.size();
+    template <typename Weight>
+    u32 ChaosGroup::BasicEffectTree<Weight>::find_subgroup(Tag::combo_id combo) const {
+        if (static_cast<size_t>(combo) >= subgroup_indices.size()) {
+            return NO_SUBGROUP;
+        }
+        return subgroup_indices[combo];
+    }
 
-        std::memset(nodes.get(), 0, (t_size - combo_count) * sizeof(Info));
+    template <typename Weight>
+    u32 ChaosGroup::BasicEffectTree<Weight>::get_subgroup(Tag::combo_id combo) const {
+        return subgroup_indices[combo];
+    }
 
-        auto it = subgroups.begin();
+    template <typename Weight>
+    u32 ChaosGroup::BasicEffectTree<Weight>::get_effect(Value weight, u32* subgroup_out) {
+        size_t subgroup_count = subgroups.size();
 
-        for (size_t i = t_size - combo_count + 1; i <= t_size; i++) {
-            Node& node = nodes[i - 1];
-            auto& [combo, subgroup_data] = *it;
-            ++it;
-            EffectSubtree& subtree = subgroup_data.subtree;
+        Value local_weight;
+        size_t s = fenwick_find(0, subgroup_count, weight, &local_weight);
 
-            node.combo = combo;
-            subgroup_data.node_pos = i;
+        // Weights at or above the sum fall past the last leaf,
+        // the last counted subgroup and effect are used then.
+        bool is_past_end = (s >= subgroup_count);
+        if (is_past_end) {
+            s = subgroup_count - 1;
+            while ((s > 0) && !(subgroups[s].is_active && (subgroups[s].count > 0))) {
+                s--;
+            }
+        }
 
-            size_t deviation = subtree.deviation_sum;
-            size_t c = is_counted(combo) ? subtree.count : 0;
+        Subgroup& subgroup = subgroups[s];
+        size_t leaf = subgroup.size;
+        if (!is_past_end) {
+            leaf = fenwick_find(subgroup_count + subgroup.offset, subgroup.size,
+                local_weight, nullptr);
+        }
 
-            bool last_child_left = (i % 2 == 0);
+        if (leaf >= subgroup.size) {
+            leaf = subgroup.size - 1;
+            while ((leaf > 0) && !actives[subgroup.offset + leaf]) {
+                leaf--;
+            }
+        }
 
-            for (size_t j = i / 2; j > 0; j /= 2) {
-                Node& parent = nodes[j - 1];
-                Info& info = parent.info;
+        *subgroup_out = s;
+        return subgroup.offset + leaf;
+    }
 
-                if (last_child_left) {
-                    info.left_deviation_sum += deviation;
-                    info.left_count += c;
-                }
-                last_child_left = (j % 2 == 0);
+    // Neumaier summation, the shared weight receives a tiny share on every pick.
+    template <typename Weight>
+    void ChaosGroup::BasicEffectTree<Weight>::add_shared_weight(Value delta) {
+        if constexpr (Weight::is_exact) {
+            shared_weight += delta;
+        } else {
+            Value sum = shared_weight + delta;
+            if (std::abs(shared_weight) >= std::abs(delta)) {
+                shared_weight_error += (shared_weight - sum) + delta;
+            } else {
+                shared_weight_error += (delta - sum) + shared_weight;
             }
-
-            deviation_sum += deviation;
-            count += c;
+            shared_weight = sum;
         }
     }
 
-    void ChaosGroup::EffectTree::update_deviations_upwards(Tag::combo_id combo, double delta) {
-        size_t i = subgroups.at(combo).node_pos;
+    template <typename Weight>
+    void ChaosGroup::BasicEffectTree<Weight>::share_weight(
+            u32 subgroup, u32 effect, double share_ratio) {
+        // Keeps the revision, so that an alias table outlives picks without sharing.
+        if (share_ratio <= 0) {
+            return;
+        }
 
-        bool last_child_left = (i % 2 == 0);
-        for (int j = i / 2; j > 0; j /= 2) {
-            Node& parent = nodes[j - 1];
-            Info& info = parent.info;
+        Value weight_share_total = Weight::scale(get_weight(effect), share_ratio);
+        Value weight_share_per_effect = weight_share_total / (total_effect_count - 1);
+        if constexpr (Weight::is_exact) {
+            // Drops the remainder of the division, so that the sum stays the same.
+            weight_share_total = weight_share_per_effect * (total_effect_count - 1);
+        }
+        add_shared_weight(weight_share_per_effect);
 
-            if (last_child_left) {
-                info.left_deviation_sum += delta;
-            }
-            last_child_left = (j % 2 == 0);
+        Value delta = -(weight_share_total + weight_share_per_effect);
+
+        deviations[effect] += delta;
+        if (actives[effect]) {
+            update_effect(subgroup, effect, delta, 0, 0);
         }
+        revision++;
 
-        deviation_sum += delta;
+        if constexpr (!Weight::is_exact) {
+            if (!is_rebasing && (get_offset(epoch) > total_effect_count)) {
+                normalize_weight_share();
+            }
+            if (is_rebasing) {
+                continue_rebase(REBASE_STEP_SIZE);
+            }
+        }
     }
 
-    void ChaosGroup::EffectTree::update_count(Tag::combo_id combo, size_t delta) {
-        size_t i = subgroups.at(combo).node_pos;
+    template <typename Weight>
+    void ChaosGroup::BasicEffectTree<Weight>::activate_node(u32 subgroup, u32 effect) {
+        if (!actives[effect]) {
+            update_effect(subgroup, effect, deviations[effect], 1, epochs[effect]);
+            actives[effect] = true;
+        }
+    }
 
-        bool last_child_left = (i % 2 == 0);
-        for (int j = i / 2; j > 0; j /= 2) {
-            Node& parent = nodes[j - 1];
-            Info& info = parent.info;
+    template <typename Weight>
+    void ChaosGroup::BasicEffectTree<Weight>::deactivate_node(u32 subgroup, u32 effect) {
+        if (actives[effect]) {
+            update_effect(subgroup, effect, -deviations[effect], -1, -epochs[effect]);
+            actives[effect] = false;
+        }
+    }
 
-            if (last_child_left) {
-                info.left_count += delta;
-            }
-            last_child_left = (j % 2 == 0);
+    // Exclusions are temporary and must be undone before the tree is used
+    // for anything else than drawing.
+    template <typename Weight>
+    void ChaosGroup::BasicEffectTree<Weight>::exclude_node(u32 subgroup, u32 effect) {
+        if (actives[effect]) {
+            update_effect(subgroup, effect, -deviations[effect], -1, -epochs[effect]);
+            actives[effect] = false;
         }
+    }
 
-        count += delta;
+    template <typename Weight>
+    void ChaosGroup::BasicEffectTree<Weight>::include_node(u32 subgroup, u32 effect) {
+        if (!actives[effect]) {
+            update_effect(subgroup, effect, deviations[effect], 1, epochs[effect]);
+            actives[effect] = true;
+        }
     }
 
-    void ChaosGroup::EffectTree::update_deviations_upwards(
-            EffectSubtree::Node& node, EffectSubtree& subgroup, double delta) {
-        subgroup.update_deviations_upwards(node, delta);
-        if (subgroup.is_active) {
-            update_deviations_upwards(node.effect.combo, delta);
+    template <typename Weight>
+    void ChaosGroup::BasicEffectTree<Weight>::activate_subgroup(u32 s) {
+        Subgroup& subgroup = subgroups[s];
+        if (!subgroup.is_active) {
+            update_subgroup(s, subgroup.deviation_sum, subgroup.count, subgroup.odd_count);
+            subgroup.is_active = true;
         }
     }
 
-    void ChaosGroup::EffectTree::update_counts_upwards(
-            EffectSubtree::Node& node, EffectSubtree& subgroup, size_t delta) {
-        subgroup.update_count(node, delta);
+    template <typename Weight>
+    void ChaosGroup::BasicEffectTree<Weight>::deactivate_subgroup(u32 s) {
+        Subgroup& subgroup = subgroups[s];
         if (subgroup.is_active) {
-            update_count(node.effect.combo, delta);
+            update_subgroup(s, -subgroup.deviation_sum, -subgroup.count, -subgroup.odd_count);
+            subgroup.is_active = false;
         }
     }
 
-
-    ChaosGroup::EffectSubtree& ChaosGroup::EffectTree::get_subgroup(Tag::combo_id combo) {
-        return subgroups.at(combo).subtree;
+    // Recomputes a node from its leaf and its already repaired children. Going
+    // in ascending order keeps the tree consistent with updates in between.
+    template <typename Weight>
+    void ChaosGroup::BasicEffectTree<Weight>::repair_fenwick_node(
+            size_t base, size_t pos, Value leaf_deviation) {
+        size_t i = pos + 1;
+        Value deviation = leaf_deviation;
+        for (size_t step = 1; step < (i & -i); step *= 2) {
+            deviation += fenwick_deviations[base + i - step - 1];
+        }
+        fenwick_deviations[base + pos] = deviation;
     }
 
-    ChaosGroup::EffectSubtree& ChaosGroup::EffectTree::get_subgroup(double weight, double* local_weight_out) {
-        size_t t_size = size();
-        size_t subgroups_count = subgroups.size();
+    template <typename Weight>
+    void ChaosGroup::BasicEffectTree<Weight>::reduce_weight_share_error(size_t node_budget) {
+        if constexpr (Weight::is_exact) {
+            return;
+        }
 
-        double local_weight = weight;
-        size_t i;
-        for (i = 1; i <= t_size - subgroups_count;) {
-            Node& node = nodes[i - 1];
-            double left_weight = get_left_weight(node);
-            if (left_weight <= weight) {
-                i = i * 2;
+        size_t subgroup_count = subgroups.size();
+        u32 node_count;
+        u32 node_odd_count;
+
+        while (node_budget > 0) {
+            if (repair_subgroup < subgroup_count) {
+                Subgroup& subgroup = subgroups[repair_subgroup];
+                size_t base = subgroup_count + subgroup.offset;
+
+                if (repair_pos < subgroup.size) {
+                    u32 effect = subgroup.offset + repair_pos;
+                    Value leaf_deviation = actives[effect] ? deviations[effect] : Weight::zero;
+                    repair_fenwick_node(base, repair_pos, leaf_deviation);
+                    repair_pos++;
+                    node_budget--;
+                    continue;
+                }
+
+                subgroup.deviation_sum = fenwick_sum(base, subgroup.size,
+                    &node_count, &node_odd_count);
+                repair_subgroup++;
+                repair_pos = 0;
+            } else if (repair_pos < subgroup_count) {
+                Subgroup& subgroup = subgroups[repair_pos];
+                Value leaf_deviation = subgroup.is_active ? subgroup.deviation_sum : Weight::zero;
+                repair_fenwick_node(0, repair_pos, leaf_deviation);
+                repair_pos++;
+                node_budget--;
             } else {
-                i = i * 2 + 1;
-                local_weight -= left_weight;
+                deviation_sum = fenwick_sum(0, subgroup_count, &node_count, &node_odd_count);
+                repair_subgroup = 0;
+                repair_pos = 0;
+                break;
             }
         }
-        Tag::combo_id combo = nodes[i - 1].combo;
+    }
 
-        if (local_weight_out) {
-            *local_weight_out = local_weight;
-        }
+    template <typename Weight>
+    void ChaosGroup::BasicEffectTree<Weight>::normalize_weight_share() {
+        // Starts a new epoch in which the shared weight is back at one. Its base
+        // is fixed now, effects are moved to it lazily by continue_rebase().
+        u8 next_epoch = epoch ^ 1;
+        epoch_bases[next_epoch] = shared_weight - Weight::one;
 
-        return subgroups.at(combo).subtree;
+        is_rebasing = true;
+        rebased_count = 0;
+        rebase_subgroup = 0;
+        rebase_pos = 0;
     }
 
-    void ChaosGroup::EffectTree::share_weight(
-            EffectSubtree::Node& node, EffectSubtree& subgroup, double share_ratio) {
-        double weight_share_total = get_weight(node) * share_ratio;
-        double weight_share_per_effect = weight_share_total / (total_effect_count - 1);
-        shared_weight += weight_share_per_effect;
+    template <typename Weight>
+    void ChaosGroup::BasicEffectTree<Weight>::rebase_node(u32 subgroup, u32 effect) {
+        u8 next_epoch = epoch ^ 1;
+        Value delta = epoch_bases[next_epoch] - epoch_bases[epochs[effect]];
 
-        double delta = -(weight_share_total + weight_share_per_effect);
+        deviations[effect] += delta;
+        epochs[effect] = next_epoch;
 
-        node.weight_deviation += delta;
-        update_deviations_upwards(node, subgroup, delta);
-
-        if (shared_weight > total_effect_count) {
-            normalize_weight_share();
+        if (actives[effect]) {
+            update_effect(subgroup, effect, delta, 0, next_epoch ? 1 : -1);
         }
+        rebased_count++;
     }
 
-    void ChaosGroup::EffectTree::activate_node(
-            EffectSubtree::Node& node, EffectSubtree& subgroup) {
-        if (!node.is_active) {
-            update_deviations_upwards(node, subgroup, node.weight_deviation);
-            update_counts_upwards(node, subgroup, 1);
-            node.is_active = true;
+    template <typename Weight>
+    void ChaosGroup::BasicEffectTree<Weight>::continue_rebase(size_t node_budget) {
+        while ((node_budget > 0) && (rebase_subgroup < subgroups.size())) {
+            Subgroup& subgroup = subgroups[rebase_subgroup];
+            if (rebase_pos >= subgroup.size) {
+                rebase_subgroup++;
+                rebase_pos = 0;
+                continue;
+            }
+
+            rebase_node(rebase_subgroup, subgroup.offset + rebase_pos);
+            rebase_pos++;
+            node_budget--;
         }
-    }
 
-    void ChaosGroup::EffectTree::deactivate_node(
-            EffectSubtree::Node& node, EffectSubtree& subgroup) {
-        if (node.is_active) {
-            update_deviations_upwards(node, subgroup, -node.weight_deviation);
-            update_counts_upwards(node, subgroup, -1);
-            node.is_active = false;
+        if (rebased_count == total_effect_count) {
+            // Every effect uses the new base, so it can be folded into the shared weight.
+            epoch ^= 1;
+            add_shared_weight(-epoch_bases[epoch]);
+            epoch_bases[0] = Weight::zero;
+            epoch_bases[1] = Weight::zero;
+            is_rebasing = false;
         }
     }
 
-    void ChaosGroup::EffectTree::activate_subgroup(Tag::combo_id combo) {
-        auto it = subgroups.find(combo);
-        if (it != subgroups.end()) {
-            auto& [combo, subgroup] = *it;
-            EffectSubtree& subtree = subgroup.subtree;
-            if (!subtree.is_active) {
-                update_deviations_upwards(combo, subtree.deviation_sum);
-                update_count(combo, subtree.count);
-                subtree.is_active = true;
+
+    template <typename Weight>
+    void ChaosGroup::BasicAliasTable<Weight>::alloc(size_t size) {
+        entries = std::make_unique<Entry[]>(size);
+        thresholds = std::make_unique<Value[]>(size);
+        aliases = std::make_unique<u32[]>(size);
+        worklist = std::make_unique<u32[]>(size);
+        count = 0;
+        is_built = false;
+    }
+
+    template <typename Weight>
+    bool ChaosGroup::BasicAliasTable<Weight>::is_outdated(const EffectTree& tree) const {
+        return (!is_built || (revision != tree.revision));
+    }
+
+    // Covers every effect, counted or not, so that status changes don't outdate it.
+    template <typename Weight>
+    void ChaosGroup::BasicAliasTable<Weight>::build(EffectTree& tree) {
+        count = 0;
+        for (u32 s = 0; s < tree.subgroups.size(); s++) {
+            typename EffectTree::Subgroup& subgroup = tree.subgroups[s];
+            for (u32 i = 0; i < subgroup.size; i++) {
+                entries[count++] = { subgroup.offset + i, s };
             }
         }
-    }
 
-    void ChaosGroup::EffectTree::deactivate_subgroup(Tag::combo_id combo) {
-        auto it = subgroups.find(combo);
-        if (it != subgroups.end()) {
-            auto& [combo, subgroup] = *it;
-            EffectSubtree& subtree = subgroup.subtree;
-            if (subtree.is_active) {
-                update_deviations_upwards(combo, -subtree.deviation_sum);
-                update_count(combo, -subtree.count);
-                subtree.is_active = false;
+        Value weight_sum = Weight::zero;
+        for (size_t i = 0; i < count; i++) {
+            weight_sum += tree.get_weight(entries[i].effect);
+        }
+
+        // Every bucket holds the weight sum, entries bring their weight times
+        // the entry count. Exact weights are shortened until that fits.
+        int shift = 0;
+        if constexpr (Weight::is_exact) {
+            while ((count > 0) && ((weight_sum >> shift) > UINT64_MAX / count)) {
+                shift++;
             }
         }
-    }
 
-    void ChaosGroup::EffectTree::normalize_weight_share() {
-        double total_sum = deviation_sum + total_effect_count * shared_weight;
-        double scale = total_effect_count / total_sum;
+        capacity = Weight::zero;
+        for (size_t i = 0; i < count; i++) {
+            Value weight = tree.get_weight(entries[i].effect);
+            if constexpr (Weight::is_exact) {
+                weight >>= shift;
+            }
+            thresholds[i] = weight * count;
+            capacity += weight;
+        }
 
-        double delta = shared_weight - 1.0 / scale;
+        // Small entries are stacked from the front of the worklist,
+        // large ones from the back.
+        size_t small_count = 0;
+        size_t large_pos = count;
+        for (size_t i = 0; i < count; i++) {
+            aliases[i] = i;
 
-        for (auto it = subgroups.begin(); it != subgroups.end(); ++it) {
-            auto& [combo, subgroup] = *it;
-            EffectSubtree& subtree = subgroup.subtree;
+            if (thresholds[i] < capacity) {
+                worklist[small_count++] = i;
+            } else {
+                worklist[--large_pos] = i;
+            }
+        }
 
-            for (size_t i = 0; i < subtree._size; i++) {
-                EffectSubtree::Node& node = subtree.nodes[i];
+        while ((small_count > 0) && (large_pos < count)) {
+            u32 small = worklist[--small_count];
+            u32 large = worklist[large_pos];
 
-                double prev_deviation = node.weight_deviation;
-                node.weight_deviation += delta;
-                node.weight_deviation *= scale;
+            aliases[small] = large;
+            thresholds[large] -= capacity - thresholds[small];
 
-                if (node.is_active) {
-                    double change = node.weight_deviation - prev_deviation;
-                    subtree.update_deviations_upwards(node, change);
-                }
+            if (thresholds[large] < capacity) {
+                large_pos++;
+                worklist[small_count++] = large;
             }
+        }
 
-            if (subtree.is_active) {
-                update_deviations_upwards(combo, delta * subtree.count);
-            }
+        // Leftovers are off from a full bucket only by rounding errors.
+        while (small_count > 0) {
+            thresholds[worklist[--small_count]] = capacity;
+        }
+        while (large_pos < count) {
+            thresholds[worklist[large_pos++]] = capacity;
         }
 
-        shared_weight = 1.0;
+        revision = tree.revision;
+        is_built = true;
     }
 
+    template <typename Weight>
+    auto ChaosGroup::BasicAliasTable<Weight>::sample(double rand) const -> const Entry& {
+        Value scaled = Weight::scale(capacity * count, rand);
+        size_t i = Weight::to_index(scaled, capacity);
+        if (i >= count) {
+            i = count - 1;
+        }
 
-    ChaosEffectEntity& ChaosGroup::EffectIterator::operator*() const {
-        EffectSubtree& subtree = tree_it->second.subtree;
-        return subtree.nodes[subtree_pos].effect;
-    }
-
-    ChaosGroup::EffectIterator& ChaosGroup::EffectIterator::operator++() {
-        subtree_pos++;
-        if (subtree_pos >= tree_it->second.subtree._size) {
-            subtree_pos = 0;
-            ++tree_it;
+        if (scaled - capacity * i < thresholds[i]) {
+            return entries[i];
         }
-        return *this;
+        return entries[aliases[i]];
     }
 
-    bool ChaosGroup::EffectIterator::operator==(const EffectIterator& other) const {
-        return ((tree_it == other.tree_it) && (subtree_pos == other.subtree_pos));
-    }
+    template struct ChaosGroup::BasicEffectTree<ChaosWeight>;
+    template struct ChaosGroup::BasicAliasTable<ChaosWeight>;
 
 
     ChaosGroup::ChaosGroup(const ChaosGroupSettings& settings) : settings(settings) {
@@ -418,11 +636,11 @@ namespace Chaos {
 
 
     ChaosGroup::EffectIterator ChaosGroup::begin() {
-        return EffectIterator(tree.subgroups.begin(), 0);
+        return tree.entities.get();
     }
 
     ChaosGroup::EffectIterator ChaosGroup::end() {
-        return EffectIterator(tree.subgroups.end(), 0);
+        return tree.entities.get() + tree.total_effect_count;
     }
 
 
@@ -444,17 +662,20 @@ namespace Chaos {
 
     void ChaosGroup::alloc_effect_slots() {
         tree.alloc_nodes();
+
+        if (settings.sampler == ChaosSamplerBackend::ALIAS) {
+            alias_table.alloc(tree.total_effect_count);
+        }
     }
 
 
-    // TODO rewrite
     ChaosEffectEntity& ChaosGroup::get_effect(Tag::combo_id combo, size_t pos) {
-        return tree.subgroups.at(combo).subtree.nodes[pos].effect;
+        EffectTree::Subgroup& subgroup = tree.subgroups[tree.get_subgroup(combo)];
+        return tree.entities[subgroup.offset + pos];
     }
 
     double ChaosGroup::get_effect_weight(ChaosEffectEntity& effect) {
-        EffectSubtree::Node& node = reinterpret_cast<EffectSubtree::Node&>(effect);
-        return tree.get_weight(node);
+        return ChaosWeight::to_double(tree.get_weight(get_effect_entity_pos(effect)));
     }
 
 
@@ -462,34 +683,100 @@ namespace Chaos {
         tree.init_tree();
     }
 
+    void ChaosGroup::reduce_weight_error() {
+        tree.reduce_weight_share_error(REPAIR_STEP_SIZE);
+    }
+
     double ChaosGroup::get_weight_sum() const {
-        return tree.get_weight_sum();
+        return ChaosWeight::to_double(tree.get_weight_sum());
     }
 
     ChaosEffectEntity& ChaosGroup::get_effect_entity_by_weight(double weight) {
-        return tree.get_subgroup(weight).get_node(weight).effect;
+        u32 subgroup;
+        return tree.entities[tree.get_effect(ChaosWeight::from_double(weight), &subgroup)];
     }
 
 
-    ChaosEffectEntity& ChaosGroup::pick_effect(double rand) {
+    // Out of range values are replaced by a draw from the machine's generator,
+    // so that seeded rolls stay reproducible.
+    ChaosEffectEntity& ChaosGroup::pick_effect(xoshiro128& rng, double rand) {
         if ((rand < 0) || (rand > 1)) {
-            rand = Rand_ZeroOne();
+            rand = rng.next_double();
         }
-        double weight = rand * get_weight_sum();
-        return pick_effect_by_weight(weight);
+
+        u32 subgroup;
+        u32 effect;
+        if (settings.sampler == ChaosSamplerBackend::ALIAS) {
+            effect = get_effect_by_alias(rand, rng, &subgroup);
+        } else {
+            effect = tree.get_effect(ChaosWeight::scale(tree.get_weight_sum(), rand), &subgroup);
+        }
+        return finish_pick(subgroup, effect);
     }
 
+    // Picks by position in the tree, whatever the sampler.
     ChaosEffectEntity& ChaosGroup::pick_effect_by_weight(double weight) {
-        double local_weight;
-        EffectSubtree& subgroup = tree.get_subgroup(weight, &local_weight);
-        EffectSubtree::Node& node = subgroup.get_node(local_weight);
+        u32 subgroup;
+        u32 effect = tree.get_effect(ChaosWeight::from_double(weight), &subgroup);
+        return finish_pick(subgroup, effect);
+    }
 
+    ChaosEffectEntity& ChaosGroup::finish_pick(u32 subgroup, u32 effect) {
         u32 effect_count = get_effect_count();
         if (effect_count > 1) {
-            tree.share_weight(node, subgroup, settings.winner_weight_share);
+            tree.share_weight(subgroup, effect, settings.winner_weight_share);
+        }
+
+        return tree.entities[effect];
+    }
+
+    size_t ChaosGroup::pick_effects(size_t count, ChaosEffectEntity* out[], bool share_weight,
+            xoshiro128& rng) {
+        size_t drawn = 0;
+        while (drawn < count) {
+            ChaosEffectEntity* effect = draw_effect(rng.next_double());
+            if (effect == nullptr) {
+                break;
+            }
+            out[drawn++] = effect;
+        }
+
+        for (size_t i = 0; i < drawn; i++) {
+            restore_drawn_effect(*out[i]);
+        }
+
+        if (share_weight) {
+            for (size_t i = 0; i < drawn; i++) {
+                commit_pick(*out[i]);
+            }
         }
 
-        return node.effect;
+        return drawn;
+    }
+
+    // Draws an effect and excludes it from further draws until it's restored.
+    ChaosEffectEntity* ChaosGroup::draw_effect(double rand) {
+        if (get_effect_count() == 0) {
+            return nullptr;
+        }
+
+        u32 subgroup;
+        u32 effect = tree.get_effect(ChaosWeight::scale(tree.get_weight_sum(), rand), &subgroup);
+        tree.exclude_node(subgroup, effect);
+
+        return &tree.entities[effect];
+    }
+
+    void ChaosGroup::restore_drawn_effect(ChaosEffectEntity& effect) {
+        tree.include_node(tree.get_subgroup(effect.combo), get_effect_entity_pos(effect));
+    }
+
+    void ChaosGroup::commit_pick(ChaosEffectEntity& effect) {
+        u32 effect_count = get_effect_count();
+        if (effect_count > 1) {
+            u32 subgroup = tree.get_subgroup(effect.combo);
+            tree.share_weight(subgroup, get_effect_entity_pos(effect), settings.winner_weight_share);
+        }
     }
 
     void ChaosGroup::set_effect_status(ChaosEffectEntity& effect, ChaosEffectStatus status) {
@@ -498,25 +785,28 @@ namespace Chaos {
         }
 
         if (status == ChaosEffectStatus::ACTIVE) {
-            auto affected = Tag::reserve_combo(effect.combo);
-            deactivate_subgroups(affected);
+            status_affected_combos.clear();
+            Tag::reserve_combo(effect.combo, status_affected_combos);
+            deactivate_subgroups(status_affected_combos);
         } else if (effect.status == ChaosEffectStatus::ACTIVE) {
-            auto affected = Tag::free_combo(effect.combo);
-            activate_subgroups(affected);
+            status_affected_combos.clear();
+            Tag::free_combo(effect.combo, status_affected_combos);
+            activate_subgroups(status_affected_combos);
+            release_waiting_effects(effect.combo);
         }
 
-        EffectSubtree::Node& node = reinterpret_cast<EffectSubtree::Node&>(effect);
-        EffectSubtree& subgroup = tree.get_subgroup(effect.combo);
+        u32 pos = get_effect_entity_pos(effect);
+        u32 subgroup = tree.get_subgroup(effect.combo);
 
         switch(status) {
             case ChaosEffectStatus::AVAILABLE: {
-                tree.activate_node(node, subgroup);
+                tree.activate_node(subgroup, pos);
                 break;
             }
             case ChaosEffectStatus::ACTIVE:
             case ChaosEffectStatus::HIDDEN:
             case ChaosEffectStatus::DISABLED: {
-                tree.deactivate_node(node, subgroup);
+                tree.deactivate_node(subgroup, pos);
                 break;
             }
         }
@@ -524,11 +814,54 @@ namespace Chaos {
         effect.status = status;
     }
 
-    void ChaosGroup::activate_subgroup(Tag::combo_id combo) {
-        tree.activate_subgroup(combo);
+    // Lets an ACTIVE effect with free instances stay in the weight tree.
+    void ChaosGroup::set_effect_rollable(ChaosEffectEntity& effect, bool is_rollable) {
+        u32 pos = get_effect_entity_pos(effect);
+        u32 subgroup = tree.get_subgroup(effect.combo);
+
+        if (is_rollable) {
+            tree.activate_node(subgroup, pos);
+        } else {
+            tree.deactivate_node(subgroup, pos);
+        }
+    }
+
+    u32 ChaosGroup::find_subgroup(Tag::combo_id combo) const {
+        return tree.find_subgroup(combo);
+    }
+
+    void ChaosGroup::activate_subgroup(u32 subgroup) {
+        tree.activate_subgroup(subgroup);
+    }
+
+    void ChaosGroup::deactivate_subgroup(u32 subgroup) {
+        tree.deactivate_subgroup(subgroup);
     }
 
-    void ChaosGroup::deactivate_subgroup(Tag::combo_id combo) {
-        tree.deactivate_subgroup(combo);
+
+    u32 ChaosGroup::get_effect_entity_pos(ChaosEffectEntity& entity) {
+        return &entity - tree.entities.get();
+    }
+
+    // Draws from the table over all effects and rejects the ones that aren't
+    // counted, which leaves the others in proportion to their weights. Once
+    // the draws keep landing on uncounted effects, the tree takes over.
+    u32 ChaosGroup::get_effect_by_alias(double rand, xoshiro128& rng, u32* subgroup_out) {
+        if (alias_table.is_outdated(tree)) {
+            alias_table.build(tree);
+        }
+
+        if ((alias_table.count > 0) && (alias_table.capacity > ChaosWeight::zero)) {
+            for (int i = 0; i < ALIAS_DRAW_LIMIT; i++) {
+                const AliasTable::Entry& entry = alias_table.sample(rand);
+                if (tree.actives[entry.effect] && tree.subgroups[entry.subgroup].is_active) {
+                    *subgroup_out = entry.subgroup;
+                    return entry.effect;
+                }
+                rand = rng.next_double();
+            }
+        }
+
+        return tree.get_effect(ChaosWeight::scale(tree.get_weight_sum(), rand), subgroup_out);
     }
-}
+}
\ No newline at end of file
@@ -2,10 +2,11 @@
 
 #include <memory>
 #include <cstring>
+#include <cmath>
 
 namespace Chaos {
     ChaosMachine::ChaosMachine(const ChaosMachineSettings& settings)
-    : settings(settings) {
+    : settings(settings), seed(Rand_Next()), rng(seed) {
         for (int i = 0; i < Disturbance::MAX; i++) {
             groups.emplace_back(settings.default_groups_settings[i]);
         }
@@ -16,6 +17,20 @@ namespace Chaos {
         return settings;
     }
 
+    u32 ChaosMachine::get_seed() const {
+        return seed;
+    }
+
+    // Restarts the random sequence, the same seed replays the same rolls.
+    void ChaosMachine::set_seed(u32 seed) {
+        this->seed = seed;
+        rng.seed(seed);
+    }
+
+    double ChaosMachine::get_random() {
+        return rng.next_double();
+    }
+
     Disturbance ChaosMachine::get_group_disturbance(ChaosGroup* group) const {
         return static_cast<Disturbance>(group - &groups[0]);
     }
@@ -24,18 +39,32 @@ namespace Chaos {
         return groups[disturbance];
     }
 
-    ChaosGroup* ChaosMachine::pick_group(double rand) {
+    // Probability of an empty group falls to the next group with effects. The
+    // residual is the position of the random value in the range of the picked
+    // group, scaled back to [0, 1), so it can be reused for picking an effect.
+    ChaosGroup* ChaosMachine::pick_group(double rand, double* residual_out) {
         if ((rand < 0) || (rand > 1)) {
-            rand = Rand_ZeroOne();
+            rand = get_random();
         }
 
+        double skipped_probability = 0.0;
         for (int i = 0; i < Disturbance::MAX; i++) {
             ChaosGroup& group = groups[i];
             double group_probability = group.get_probability();
 
-            if ((rand < group_probability) && (group.get_effect_count() > 0)) {
+            if (group.get_effect_count() == 0) {
+                skipped_probability += group_probability;
+            } else if (rand < group_probability) {
+                if (residual_out != nullptr) {
+                    double range = skipped_probability + group_probability;
+                    double residual = (rand + skipped_probability) / range;
+                    *residual_out = (residual < 1.0) ? residual : std::nextafter(1.0, 0.0);
+                }
+
                 group.apply_on_pick_multiplier();
                 return &group;
+            } else {
+                skipped_probability = 0.0;
             }
             rand -= group_probability;
         }
@@ -43,8 +72,40 @@ namespace Chaos {
         return nullptr;
     }
 
+    // Picks a group with at least one effect left, ignoring the empty space.
+    ChaosGroup* ChaosMachine::pick_nonempty_group(double rand) {
+        double probability_sum = 0.0;
+        for (int i = 0; i < Disturbance::MAX; i++) {
+            ChaosGroup& group = groups[i];
+            if (group.get_effect_count() > 0) {
+                probability_sum += group.get_probability();
+            }
+        }
+
+        if (probability_sum <= 0.0) {
+            return nullptr;
+        }
+
+        rand *= probability_sum;
+        ChaosGroup* ret = nullptr;
+        for (int i = 0; i < Disturbance::MAX; i++) {
+            ChaosGroup& group = groups[i];
+            if (group.get_effect_count() == 0) {
+                continue;
+            }
+
+            ret = &group;
+            if (rand < group.get_probability()) {
+                break;
+            }
+            rand -= group.get_probability();
+        }
+
+        return ret;
+    }
+
     void ChaosMachine::perform_roll(ChaosGroup& group, double rand) {
-        ChaosEffectEntity& effect = group.pick_effect(rand);
+        ChaosEffectEntity& effect = group.pick_effect(rng, rand);
 
         debug_log("Selected '%s' effect.\n\tEffect's weight after selection: %f.",
             effect.effect.name, group.get_effect_weight(effect));
@@ -59,7 +120,8 @@ namespace Chaos {
     void ChaosMachine::perform_roll(double group_rand, double effect_rand) {
         debug_log("Beginning roll in '%s' chaos machine.", settings.name);
 
-        ChaosGroup* group = pick_group(group_rand);
+        bool is_unified = settings.unified_roll && ((effect_rand < 0) || (effect_rand > 1));
+        ChaosGroup* group = pick_group(group_rand, is_unified ? &effect_rand : nullptr);
 
         if (group != nullptr) {
             Disturbance disturbance = get_group_disturbance(group);
@@ -74,6 +136,57 @@ namespace Chaos {
         debug_log("Roll finished.");
     }
 
+    size_t ChaosMachine::pick_effects(size_t count, ChaosEffectEntity* out[], bool share_weight) {
+        size_t drawn = 0;
+        while (drawn < count) {
+            ChaosGroup* group = pick_nonempty_group(get_random());
+            if (group == nullptr) {
+                break;
+            }
+
+            out[drawn++] = group->draw_effect(get_random());
+        }
+
+        for (size_t i = 0; i < drawn; i++) {
+            out[i]->owner->restore_drawn_effect(*out[i]);
+        }
+
+        if (share_weight) {
+            for (size_t i = 0; i < drawn; i++) {
+                commit_pick(*out[i]);
+            }
+        }
+
+        return drawn;
+    }
+
+    size_t ChaosMachine::pick_effects(Disturbance disturbance, size_t count,
+            ChaosEffectEntity* out[], bool share_weight) {
+        ChaosGroup& group = groups[disturbance];
+        return group.pick_effects(count, out, share_weight, rng);
+    }
+
+    void ChaosMachine::commit_pick(ChaosEffectEntity& entity) {
+        ChaosGroup& group = *entity.owner;
+
+        group.apply_on_pick_multiplier();
+        group.commit_pick(entity);
+    }
+
+    void ChaosMachine::add_effect_instances(
+            ChaosEffectEntity& entity, const ChaosInstanceSettings& settings) {
+        entity.instance_block = active_effects.add_instance_block(settings);
+    }
+
+    // Enough slots for every effect and every instance of the machine to be active at once.
+    void ChaosMachine::alloc_active_effects() {
+        u32 effect_count = 0;
+        for (int i = 0; i < Disturbance::MAX; i++) {
+            effect_count += groups[i].size();
+        }
+        active_effects.alloc(effect_count);
+    }
+
     void ChaosMachine::update() {
         u32 cycle_length = debug_disable_rolling ? 0 : settings.cycle_length;
         if (cycle_length > 0) {
@@ -103,6 +216,10 @@ namespace Chaos {
             }
         }
 
+        for (int i = 0; i < Disturbance::MAX; i++) {
+            groups[i].reduce_weight_error();
+        }
+
         active_effects.update();
         active_effects.empty_remove_queue();
     }
@@ -139,25 +256,25 @@ namespace Chaos {
             entity.effect.name, settings.name);
     }
 
+    // Stops every instance of instanced effects.
     void ChaosMachine::stop_effect(ChaosEffectEntity& entity) {
         ChaosGroup& group = *entity.owner;
 
-        switch (entity.status) {
-            case ChaosEffectStatus::ACTIVE:
-                // TODO Check tags.
-                active_effects.queue_for_remove_entity(entity);
-                debug_log("Stopped '%s' effect in '%s' chaos machine.",
-                    entity.effect.name, settings.name);
-                break;
-            default:
-                break;
+        if (active_effects.get_instance_count(entity) > 0) {
+            // TODO Check tags.
+            active_effects.queue_for_remove_entity(entity);
+            debug_log("Stopped '%s' effect in '%s' chaos machine.",
+                entity.effect.name, settings.name);
         }
     }
 
     void ChaosMachine::activate_effect(ChaosEffectEntity& entity) {
         ChaosGroup& group = *entity.owner;
 
-        if (!Tag::is_combo_allowed(entity.combo)) {
+        // Further instances share the reservation of the first one.
+        bool holds_tags = (entity.status == ChaosEffectStatus::ACTIVE)
+            && (entity.instance_block != NO_INSTANCE_BLOCK);
+        if (!holds_tags && !Tag::is_combo_allowed(entity.combo)) {
             error("Can't activate '%s' effect because of a tag conflict.",
                 entity.effect.name);
             return;
@@ -174,12 +291,20 @@ namespace Chaos {
         return active_effects.get_timer(entity);
     }
 
+    u32 ChaosMachine::get_instance_count(const ChaosEffectEntity& entity) const {
+        return active_effects.get_instance_count(entity);
+    }
+
+    void* ChaosMachine::get_instance_state(const ChaosEffectEntity& entity, u32 instance) const {
+        return active_effects.get_instance_state(entity, instance);
+    }
+
 
-    void ChaosMachine::pause_effects(const std::unordered_set<Tag::combo_id>& affected_combos) {
+    void ChaosMachine::pause_effects(const Tag::combo_set& affected_combos) {
         active_effects.pause_effects(affected_combos);
     }
 
-    void ChaosMachine::unpause_effects(const std::unordered_set<Tag::combo_id>& affected_combos) {
+    void ChaosMachine::unpause_effects(const Tag::combo_set& affected_combos) {
         active_effects.unpause_effects(affected_combos);
     }
 }
\ No newline at end of file
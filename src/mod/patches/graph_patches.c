@@ -21,9 +21,9 @@ void update_cutscene_tag(PlayState* play) {
 
     if (in_cutscene != prev_in_cutscene) {
         if (in_cutscene) {
-            chaos_forbid_tag(CHAOS_TAG_CUTSCENE);
+            chaos_forbid_tag_handle(CHAOS_TAG_HANDLE_CUTSCENE);
         } else {
-            chaos_allow_tag(CHAOS_TAG_CUTSCENE);
+            chaos_allow_tag_handle(CHAOS_TAG_HANDLE_CUTSCENE);
         }
         prev_in_cutscene = in_cutscene;
     }
@@ -36,9 +36,9 @@ void update_player_inactive_tag() {
 
     if (is_paused != prev_is_paused) {
         if (is_paused) {
-            chaos_forbid_tag(CHAOS_TAG_PLAYER_INACTIVE);
+            chaos_forbid_tag_handle(CHAOS_TAG_HANDLE_PLAYER_INACTIVE);
         } else {
-            chaos_allow_tag(CHAOS_TAG_PLAYER_INACTIVE);
+            chaos_allow_tag_handle(CHAOS_TAG_HANDLE_PLAYER_INACTIVE);
         }
         prev_is_paused = is_paused;
     }
@@ -2,47 +2,91 @@
 #include "tag.h"
 
 #include <unordered_map>
-#include <map>
 #include <algorithm>
+#include <cstdint>
+#include <string_view>
 
 namespace Chaos {
     namespace Tag {
         using tag_id = int;
         using combo_id = int;
 
+        using mask_word = std::uint32_t;
+
         constexpr tag_id FIRST_TAG_ID = 0;
         constexpr combo_id FIRST_COMBO_ID = 1;
+        constexpr size_t MASK_WORD_BITS = 32;
+        constexpr size_t INLINE_TAG_COUNT = 16; // combos up to this size are looked up without allocating.
+        constexpr combo_id NO_COMBO = 0;
 
+        // Tag names are hierarchical, "camera.fov" is a child of "camera". Combos
+        // contain the ancestors of their tags as well, so excluding or reserving
+        // a parent blocks the combos of all its descendants at once.
         struct Tag {
             std::vector<combo_id> related_combos; // ids of combos containing this tag.
             size_t reservations = 1;
+            tag_id parent = NO_TAG;
             bool excluded = false;
+            bool is_registered = false;
+            bool has_children = false;
         };
 
         struct Combo {
-            std::vector<tag_id> expanded; // expanded combo in the form of vector<tag>.
-            size_t conflicts = 0;
-            size_t exclusions = 0;
+            std::uint32_t first_tag; // position of the sorted tags in combo_tags.
+            std::uint32_t tag_count;
+            std::uint32_t hash;
+        };
+
+        // Allows looking up tag names without building a std::string first.
+        struct TagNameHash {
+            using is_transparent = void;
+
+            size_t operator()(std::string_view tagname) const {
+                return std::hash<std::string_view>{}(tagname);
+            }
         };
 
         tag_id next_tag_id = FIRST_TAG_ID;
         combo_id next_combo_id = FIRST_COMBO_ID;
 
-        std::unordered_map<std::string, tag_id> tags;
-        std::map<std::vector<tag_id>, combo_id> combos;
+        std::unordered_map<std::string, tag_id, TagNameHash, std::equal_to<>> tags;
+
+        // Combos are interned in an open addressing table of combo ids (NO_COMBO
+        // for empty slots) keyed by the hash of their sorted tag ids. The tag ids
+        // of all combos are stored back to back in combo_tags.
+        std::vector<combo_id> combo_table;
+        std::vector<tag_id> combo_tags;
 
         std::vector<Tag> tag_data;
         std::vector<Combo> combo_data;
 
+        // Combos are stored as tag bitsets of mask_words words each, back to back.
+        // A combo is allowed when it shares no bit with the blocked mask, which holds
+        // tags with exhausted reservations and excluded tags.
+        size_t mask_words = 1;
+        std::vector<mask_word> combo_masks;
+        std::vector<mask_word> blocked_mask(1);
+        std::vector<mask_word> exhausted_mask(1);
+        std::vector<mask_word> excluded_mask(1);
+        std::vector<mask_word> changed_mask(1); // tags whose blocked bit flipped.
+
         void clear() {
             next_tag_id = FIRST_TAG_ID;
             next_combo_id = FIRST_COMBO_ID;
 
             tags.clear();
-            combos.clear();
+            combo_table.clear();
+            combo_tags.clear();
 
             tag_data.clear();
             combo_data.clear();
+
+            mask_words = 1;
+            combo_masks.clear();
+            blocked_mask.assign(mask_words, 0);
+            exhausted_mask.assign(mask_words, 0);
+            excluded_mask.assign(mask_words, 0);
+            changed_mask.assign(mask_words, 0);
         }
 
 
@@ -54,96 +98,248 @@ namespace Chaos {
             return combo_data[id - FIRST_COMBO_ID];
         }
 
-        template<typename K, typename V, typename M>
-        V get_id(const K& key, V& next_id_counter, M& id_map) {
-            auto it = id_map.find(key);
-            if (it != id_map.end()) {
-                return it->second;
-            } else {
-                tag_id id = next_id_counter;
-                next_id_counter++;
+        inline const mask_word* get_combo_mask(combo_id id) {
+            return &combo_masks[(id - FIRST_COMBO_ID) * mask_words];
+        }
+
+        inline bool test_bit(const std::vector<mask_word>& mask, tag_id id) {
+            size_t bit = id - FIRST_TAG_ID;
+            return (mask[bit / MASK_WORD_BITS] >> (bit % MASK_WORD_BITS)) & 1;
+        }
+
+        inline void flip_bit(std::vector<mask_word>& mask, tag_id id) {
+            size_t bit = id - FIRST_TAG_ID;
+            mask[bit / MASK_WORD_BITS] ^= mask_word(1) << (bit % MASK_WORD_BITS);
+        }
 
-                id_map.emplace(key, id);
-                return id;
+        inline bool intersects(const mask_word* combo_mask, const std::vector<mask_word>& mask) {
+            mask_word any = 0;
+            for (size_t i = 0; i < mask_words; i++) {
+                any |= combo_mask[i] & mask[i];
             }
+            return (any != 0);
         }
 
-        tag_id get_tag_id(const std::string& tagname) {
-            tag_id prev_next_id = next_tag_id;
-            tag_id id = get_id(tagname, next_tag_id, tags);
+        // Doubles the width of all masks until the tag fits. Tags are only created
+        // while registering, runtime lookups go through find_tag_id.
+        void fit_masks(tag_id id) {
+            size_t words = mask_words;
+            while ((id - FIRST_TAG_ID) >= static_cast<tag_id>(words * MASK_WORD_BITS)) {
+                words *= 2;
+            }
+            if (words == mask_words) {
+                return;
+            }
 
-            if (prev_next_id != next_tag_id) {
-                tag_data.emplace_back();
+            std::vector<mask_word> wide_masks(combo_data.size() * words, 0);
+            for (size_t i = 0; i < combo_data.size(); i++) {
+                std::copy_n(&combo_masks[i * mask_words], mask_words, &wide_masks[i * words]);
             }
-            return id;
+            combo_masks = std::move(wide_masks);
+
+            mask_words = words;
+            blocked_mask.resize(mask_words, 0);
+            exhausted_mask.resize(mask_words, 0);
+            excluded_mask.resize(mask_words, 0);
+            changed_mask.resize(mask_words, 0);
         }
 
-        bool add_tag(const std::string& tagname, size_t reservation_limit) {
-            tag_id prev_next_id = next_tag_id;
-            tag_id id = get_tag_id(tagname);
+        // Collects combos whose allowed state differs before and after flipping
+        // the changed tags, then clears the changed mask.
+        void collect_affected_combos(combo_set& affected_combos) {
+            for (size_t i = 0; i < combo_data.size(); i++) {
+                const mask_word* combo_mask = &combo_masks[i * mask_words];
+
+                mask_word changed = 0;
+                mask_word prev_blocked = 0;
+                mask_word cur_blocked = 0;
+                for (size_t j = 0; j < mask_words; j++) {
+                    changed |= combo_mask[j] & changed_mask[j];
+                    prev_blocked |= combo_mask[j] & (blocked_mask[j] ^ changed_mask[j]);
+                    cur_blocked |= combo_mask[j] & blocked_mask[j];
+                }
 
-            if (prev_next_id != next_tag_id) {
-                Tag& tag = get_tag_data(id);
-                tag.reservations = reservation_limit;
-                return true;
+                if ((changed != 0) && ((prev_blocked != 0) != (cur_blocked != 0))) {
+                    affected_combos.insert(i + FIRST_COMBO_ID);
+                }
+            }
+
+            std::fill(changed_mask.begin(), changed_mask.end(), 0);
+        }
+
+        // "camera.*" is another name for "camera".
+        inline std::string_view strip_wildcard(std::string_view tagname) {
+            if (tagname.ends_with(".*")) {
+                tagname.remove_suffix(2);
             }
-            return false;
+            return tagname;
         }
 
-        combo_id get_combo_id(std::vector<tag_id>&& combo) {
-            combo_id prev_next_id = next_combo_id;
-            combo_id id = get_id(combo, next_combo_id, combos);
+        tag_id find_tag_id(std::string_view tagname) {
+            auto it = tags.find(strip_wildcard(tagname));
+            return (it != tags.end()) ? it->second : NO_TAG;
+        }
 
-            if (prev_next_id != next_combo_id) {
-                for (auto tag : combo) {
-                    get_tag_data(tag).related_combos.push_back(id);
+        tag_id get_tag_id(std::string_view tagname) {
+            tagname = strip_wildcard(tagname);
+
+            auto it = tags.find(tagname);
+            if (it != tags.end()) {
+                return it->second;
+            }
+
+            tag_id parent = NO_TAG;
+            size_t separator = tagname.rfind('.');
+            if (separator != std::string_view::npos) {
+                parent = get_tag_id(tagname.substr(0, separator));
+
+                // Parents that weren't registered don't limit their children.
+                // One already reserved as a plain tag keeps its limit.
+                Tag& parent_tag = get_tag_data(parent);
+                if (!parent_tag.has_children && !parent_tag.is_registered
+                        && !test_bit(exhausted_mask, parent)) {
+                    parent_tag.reservations = SIZE_MAX;
                 }
-                combo_data.emplace_back(std::move(combo));
+                parent_tag.has_children = true;
             }
+
+            tag_id id = next_tag_id;
+            next_tag_id++;
+
+            tags.emplace(tagname, id);
+            tag_data.emplace_back().parent = parent;
+            fit_masks(id);
             return id;
         }
 
-        combo_id get_combo_id(const std::vector<std::string>& tag_names) {
-            std::vector<tag_id> combo;
+        bool add_tag(std::string_view tagname, size_t reservation_limit) {
+            tag_id id = get_tag_id(tagname);
 
-            for (const std::string& tagname : tag_names) {
-                combo.push_back(get_tag_id(tagname));
+            Tag& tag = get_tag_data(id);
+            if (tag.is_registered) {
+                return false;
             }
-            std::sort(combo.begin(), combo.end());
 
-            return get_combo_id(std::move(combo));
+            tag.reservations = reservation_limit;
+            tag.is_registered = true;
+            return true;
         }
 
-        combo_id get_combo_id(const char* tag_names[], size_t tag_count) {
+
+        std::uint32_t hash_combo(const tag_id* sorted_tags, size_t tag_count) {
+            std::uint32_t hash = 2166136261u;
+            for (size_t i = 0; i < tag_count; i++) {
+                hash = (hash ^ static_cast<std::uint32_t>(sorted_tags[i])) * 16777619u;
+            }
+            return hash;
+        }
+
+        bool is_same_combo(const Combo& combo, const tag_id* sorted_tags, size_t tag_count) {
+            return (combo.tag_count == tag_count)
+                && std::equal(sorted_tags, sorted_tags + tag_count, &combo_tags[combo.first_tag]);
+        }
+
+        // Keeps the table at most half full.
+        void grow_combo_table() {
+            size_t capacity = combo_table.empty() ? 64 : combo_table.size() * 2;
+            combo_table.assign(capacity, NO_COMBO);
+
+            for (size_t i = 0; i < combo_data.size(); i++) {
+                size_t slot = combo_data[i].hash & (capacity - 1);
+                while (combo_table[slot] != NO_COMBO) {
+                    slot = (slot + 1) & (capacity - 1);
+                }
+                combo_table[slot] = i + FIRST_COMBO_ID;
+            }
+        }
+
+        combo_id intern_combo(const tag_id* sorted_tags, size_t tag_count) {
             if (tag_count == 0) {
                 return 0;
             }
 
-            std::vector<std::string> vec;
+            if ((combo_data.size() + 1) * 2 > combo_table.size()) {
+                grow_combo_table();
+            }
+
+            std::uint32_t hash = hash_combo(sorted_tags, tag_count);
+            size_t mask = combo_table.size() - 1;
+            size_t slot = hash & mask;
+            while (combo_table[slot] != NO_COMBO) {
+                combo_id id = combo_table[slot];
+                const Combo& combo = get_combo_data(id);
+                if ((combo.hash == hash) && is_same_combo(combo, sorted_tags, tag_count)) {
+                    return id;
+                }
+                slot = (slot + 1) & mask;
+            }
+
+            combo_id id = next_combo_id;
+            next_combo_id++;
+            combo_table[slot] = id;
+
+            combo_masks.resize(combo_masks.size() + mask_words, 0);
+            mask_word* combo_mask = &combo_masks[(id - FIRST_COMBO_ID) * mask_words];
+
             for (size_t i = 0; i < tag_count; i++) {
-                const char* tagname = tag_names[i];
-                vec.emplace_back(tagname);
+                tag_id tag = sorted_tags[i];
+                get_tag_data(tag).related_combos.push_back(id);
+
+                size_t bit = tag - FIRST_TAG_ID;
+                combo_mask[bit / MASK_WORD_BITS] |= mask_word(1) << (bit % MASK_WORD_BITS);
             }
-            return get_combo_id(vec);
-        }
 
+            combo_data.push_back({
+                .first_tag = static_cast<std::uint32_t>(combo_tags.size()),
+                .tag_count = static_cast<std::uint32_t>(tag_count),
+                .hash = hash,
+            });
+            combo_tags.insert(combo_tags.end(), sorted_tags, sorted_tags + tag_count);
+            return id;
+        }
 
-        template <int V>
-        std::unordered_set<combo_id> modify_reservations(std::vector<tag_id> tags) {
-            std::unordered_set<combo_id> affected_combos;
+        template <typename Names>
+        combo_id resolve_combo(const Names& tag_names, size_t tag_count) {
+            tag_id inline_tags[INLINE_TAG_COUNT];
+            std::vector<tag_id> heap_tags;
+            size_t closure_count = 0;
 
-            std::unordered_set<combo_id> prev_allowed;
-            for (auto tag : tags) {
-                Tag& tag_data = get_tag_data(tag);
-                auto& related = tag_data.related_combos;
-                for (auto combo : related) {
-                    if (is_combo_allowed(combo)) {
-                        prev_allowed.insert(combo);
+            for (size_t i = 0; i < tag_count; i++) {
+                tag_id id = get_tag_id(tag_names[i]);
+                for (; id != NO_TAG; id = get_tag_data(id).parent) {
+                    if (closure_count < INLINE_TAG_COUNT) {
+                        inline_tags[closure_count] = id;
+                    } else {
+                        if (heap_tags.empty()) {
+                            heap_tags.assign(inline_tags, inline_tags + INLINE_TAG_COUNT);
+                        }
+                        heap_tags.push_back(id);
                     }
+                    closure_count++;
                 }
             }
 
-            for (auto tag : tags) {
+            tag_id* sorted_tags = heap_tags.empty() ? inline_tags : heap_tags.data();
+            std::sort(sorted_tags, sorted_tags + closure_count);
+            closure_count = std::unique(sorted_tags, sorted_tags + closure_count) - sorted_tags;
+
+            return intern_combo(sorted_tags, closure_count);
+        }
+
+        combo_id get_combo_id(const std::vector<std::string>& tag_names) {
+            return resolve_combo(tag_names, tag_names.size());
+        }
+
+        combo_id get_combo_id(const char* tag_names[], size_t tag_count) {
+            return resolve_combo(tag_names, tag_count);
+        }
+
+
+        template <int V>
+        void modify_reservations(const tag_id* tags, size_t tag_count, combo_set& affected_combos) {
+            bool any_changed = false;
+            for (size_t i = 0; i < tag_count; i++) {
+                tag_id tag = tags[i];
                 Tag& tag_data = get_tag_data(tag);
 
                 tag_data.reservations += V;
@@ -160,103 +356,109 @@ namespace Chaos {
                 }
 
                 if (modify_conflicts) {
-                    constexpr int val_change = (V < 0) ? +1 : -1;
+                    flip_bit(exhausted_mask, tag);
 
-                    auto& related = tag_data.related_combos;
-                    for (auto combo : related) {
-                        Combo& combo_data = get_combo_data(combo);
-                        combo_data.conflicts += val_change;
+                    // An excluded tag stays blocked either way.
+                    if (!tag_data.excluded) {
+                        flip_bit(blocked_mask, tag);
+                        flip_bit(changed_mask, tag);
+                        any_changed = true;
                     }
                 }
             }
 
-            for (auto tag : tags) {
-                Tag& tag_data = get_tag_data(tag);
-                auto& related = get_tag_data(tag).related_combos;
-                for (auto combo : related) {
-                    bool cur = is_combo_allowed(combo);
-                    bool prev = prev_allowed.contains(combo);
-                    if (cur != prev) {
-                        affected_combos.insert(combo);
-                    }
-                }
+            if (any_changed) {
+                collect_affected_combos(affected_combos);
             }
-
-            return affected_combos;
         }
 
         template <int V>
-        std::unordered_set<combo_id> modify_reservations(combo_id id) {
+        void modify_reservations(combo_id id, combo_set& affected_combos) {
             if (id == 0) {
-                std::unordered_set<combo_id> empty;
-                return empty;
+                return;
             }
 
             Combo& combo = get_combo_data(id);
-            auto& expanded_combo = combo.expanded;
-
-            return modify_reservations<V>(expanded_combo);
+            modify_reservations<V>(&combo_tags[combo.first_tag], combo.tag_count, affected_combos);
         }
 
-        std::unordered_set<combo_id> reserve_combo(combo_id id) {
-            return modify_reservations<-1>(id);
+        void reserve_combo(combo_id id, combo_set& affected_combos) {
+            modify_reservations<-1>(id, affected_combos);
         }
 
-        std::unordered_set<combo_id> free_combo(combo_id id) {
-            return modify_reservations<+1>(id);
+        void free_combo(combo_id id, combo_set& affected_combos) {
+            modify_reservations<+1>(id, affected_combos);
         }
 
 
         template <bool V>
-        std::pair<bool, std::unordered_set<combo_id>> modify_tag_exclusion(tag_id id) {
+        bool modify_tag_exclusion(tag_id id, combo_set& affected_combos) {
             Tag& tag = get_tag_data(id);
 
             bool modified = (tag.excluded != V);
-            std::unordered_set<combo_id> affected_combos;
-
             if (modified) {
-                auto& related = tag.related_combos;
-
-                std::unordered_set<combo_id> prev_allowed;
-                for (auto combo : related) {
-                    if (is_combo_allowed(combo)) {
-                        prev_allowed.insert(combo);
-                    }
-                }
-
                 tag.excluded = V;
-                for (auto combo : related) {
-                    constexpr int val_change = V ? +1 : -1;
-                    get_combo_data(combo).exclusions += val_change;
-                }
+                flip_bit(excluded_mask, id);
 
-                for (auto combo : related) {
-                    bool cur = is_combo_allowed(combo);
-                    bool prev = prev_allowed.contains(combo);
-                    if (cur != prev) {
-                        affected_combos.insert(combo);
-                    }
+                // A tag with exhausted reservations stays blocked either way.
+                if (!test_bit(exhausted_mask, id)) {
+                    flip_bit(blocked_mask, id);
+                    flip_bit(changed_mask, id);
+                    collect_affected_combos(affected_combos);
                 }
             }
-            return std::make_pair(modified, affected_combos);
+            return modified;
+        }
+
+        bool include_tag(tag_id id, combo_set& affected_combos) {
+            return modify_tag_exclusion<false>(id, affected_combos);
+        }
+
+        bool exclude_tag(tag_id id, combo_set& affected_combos) {
+            return modify_tag_exclusion<true>(id, affected_combos);
+        }
+
+
+        size_t get_combo_count() {
+            return next_combo_id;
         }
 
-        std::pair<bool, std::unordered_set<combo_id>> include_tag(tag_id id) {
-            return modify_tag_exclusion<false>(id);
+        bool is_tag_valid(tag_id id) {
+            return (id >= FIRST_TAG_ID) && (id < next_tag_id);
         }
 
-        std::pair<bool, std::unordered_set<combo_id>> exclude_tag(tag_id id) {
-            return modify_tag_exclusion<true>(id);
+        bool is_tag_excluded(tag_id id) {
+            return test_bit(excluded_mask, id);
         }
 
+        bool is_tag_blocked(tag_id id) {
+            return test_bit(blocked_mask, id);
+        }
+
+        tag_id find_blocking_tag(combo_id id) {
+            for (tag_id tag : get_combo_tags(id)) {
+                if (test_bit(blocked_mask, tag)) {
+                    return tag;
+                }
+            }
+            return NO_TAG;
+        }
+
+        std::span<const tag_id> get_combo_tags(combo_id id) {
+            if (id == 0) {
+                return {};
+            }
+
+            const Combo& combo = get_combo_data(id);
+            return { &combo_tags[combo.first_tag], combo.tag_count };
+        }
 
         bool is_combo_allowed(combo_id id) {
             if (id == 0) {
                 return true;
             }
 
-            Combo& combo = get_combo_data(id);
-            return ((combo.exclusions == 0) && (combo.conflicts == 0));
+            return !intersects(get_combo_mask(id), blocked_mask);
         }
 
         bool is_combo_included(combo_id id) {
@@ -264,8 +466,7 @@ namespace Chaos {
                 return true;
             }
 
-            Combo& combo = get_combo_data(id);
-            return (combo.exclusions == 0);
+            return !intersects(get_combo_mask(id), excluded_mask);
         }
 
         const std::vector<combo_id>& get_related_combos(tag_id id) {
@@ -2,29 +2,42 @@
 #define TAG_H
 
 #include "util/debug.h"
+#include "util/dense_set.h"
 
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <unordered_set>
 
 namespace Chaos {
     namespace Tag {
         using tag_id = int;
         using combo_id = int;
+        using combo_set = dense_set<combo_id>;
+
+        constexpr tag_id NO_TAG = -1;
 
         void clear();
 
-        tag_id get_tag_id(const std::string& tagname);
-        bool add_tag(const std::string& tagname, size_t limit);
+        tag_id get_tag_id(std::string_view tagname); // creates unknown tags.
+        tag_id find_tag_id(std::string_view tagname); // NO_TAG for unknown tags.
+        bool add_tag(std::string_view tagname, size_t limit);
         combo_id get_combo_id(const std::vector<std::string>& tag_names);
         combo_id get_combo_id(const char* tag_names[], size_t tag_count);
 
-        std::unordered_set<combo_id> reserve_combo(combo_id id);
-        std::unordered_set<combo_id> free_combo(combo_id id);
+        // Combos whose allowed state changed are added to the affected set.
+        void reserve_combo(combo_id id, combo_set& affected_combos);
+        void free_combo(combo_id id, combo_set& affected_combos);
 
-        std::pair<bool, std::unordered_set<combo_id>> include_tag(tag_id id);
-        std::pair<bool, std::unordered_set<combo_id>> exclude_tag(tag_id id);
+        bool include_tag(tag_id id, combo_set& affected_combos);
+        bool exclude_tag(tag_id id, combo_set& affected_combos);
 
+        size_t get_combo_count(); // valid combo ids are below it.
+        bool is_tag_valid(tag_id id);
+        bool is_tag_excluded(tag_id id);
+        bool is_tag_blocked(tag_id id);
+        tag_id find_blocking_tag(combo_id id); // NO_TAG for allowed combos.
+        std::span<const tag_id> get_combo_tags(combo_id id);
         bool is_combo_allowed(combo_id id);
         bool is_combo_included(combo_id id);
         const std::vector<combo_id>& get_related_combos(tag_id id);
@@ -4,4 +4,8 @@
 #define CHAOS_TAG_CUTSCENE "*cutscene"
 #define CHAOS_TAG_PLAYER_INACTIVE "*player_inactive"
 
+// Built-in tags are registered first, so their handles are known in advance.
+#define CHAOS_TAG_HANDLE_PLAYER_INACTIVE 0
+#define CHAOS_TAG_HANDLE_CUTSCENE 1
+
 #endif /* __TAG_NAMES_H__ */
\ No newline at end of file
@@ -0,0 +1,71 @@
+#ifndef __DENSE_SET_H__
+#define __DENSE_SET_H__
+
+#include <vector>
+
+// Set of small non-negative integers with O(1) insert, lookup and clear.
+// Clearing keeps the storage, so a reused set stops allocating once it
+// has seen its largest value and its largest size.
+template <typename T>
+class dense_set {
+private:
+    std::vector<T> members;
+    std::vector<std::size_t> positions; // indexed by value, only valid for members.
+
+public:
+    using const_iterator = typename std::vector<T>::const_iterator;
+
+    void reserve(std::size_t value_count) {
+        members.reserve(value_count);
+        if (positions.size() < value_count) {
+            positions.resize(value_count);
+        }
+    }
+
+    bool contains(T value) const {
+        std::size_t key = static_cast<std::size_t>(value);
+        if (key >= positions.size()) {
+            return false;
+        }
+
+        std::size_t pos = positions[key];
+        return (pos < members.size()) && (members[pos] == value);
+    }
+
+    bool insert(T value) {
+        if (contains(value)) {
+            return false;
+        }
+
+        std::size_t key = static_cast<std::size_t>(value);
+        if (key >= positions.size()) {
+            positions.resize(key + 1);
+        }
+
+        positions[key] = members.size();
+        members.push_back(value);
+        return true;
+    }
+
+    void clear() {
+        members.clear();
+    }
+
+    std::size_t size() const {
+        return members.size();
+    }
+
+    bool empty() const {
+        return members.empty();
+    }
+
+    const_iterator begin() const {
+        return members.begin();
+    }
+
+    const_iterator end() const {
+        return members.end();
+    }
+};
+
+#endif /* __DENSE_SET_H__ */
@@ -0,0 +1,143 @@
+#ifndef __TIMER_WHEEL_H__
+#define __TIMER_WHEEL_H__
+
+#include <cstdint>
+#include <memory>
+
+// Hierarchical timer wheel over ids in range [0, capacity), keyed on absolute
+// ticks. Every level has 64 slots, each one spanning a whole turn of the level
+// below it. A timer moves down a level whenever the wheel enters its slot, so
+// it's touched at most once per level. Deadlines past the last level wait in
+// an overflow list, which is redistributed each time the last level wraps.
+class timer_wheel {
+private:
+    static constexpr int SLOT_BITS = 6;
+    static constexpr std::uint32_t SLOT_COUNT = 1 << SLOT_BITS;
+    static constexpr int LEVEL_COUNT = 4;
+    static constexpr std::uint32_t OVERFLOW_LIST = LEVEL_COUNT * SLOT_COUNT;
+    static constexpr std::uint32_t LIST_COUNT = OVERFLOW_LIST + 1;
+
+public:
+    static constexpr std::uint32_t NO_ID = UINT32_MAX;
+
+private:
+    struct Timer {
+        std::uint64_t deadline;
+        std::uint32_t prev;
+        std::uint32_t next;
+        std::uint32_t list; // NO_ID when not scheduled.
+    };
+
+    std::unique_ptr<Timer[]> timers;
+    std::uint32_t heads[LIST_COUNT];
+    std::uint64_t now = 0;
+
+    std::uint32_t get_list(std::uint64_t deadline) const {
+        std::uint64_t diff = deadline ^ now;
+        for (int level = 0; level < LEVEL_COUNT; level++) {
+            if (diff < (std::uint64_t(1) << (SLOT_BITS * (level + 1)))) {
+                std::uint32_t slot = (deadline >> (SLOT_BITS * level)) & (SLOT_COUNT - 1);
+                return level * SLOT_COUNT + slot;
+            }
+        }
+        return OVERFLOW_LIST;
+    }
+
+    void link(std::uint32_t id, std::uint32_t list) {
+        Timer& timer = timers[id];
+        timer.list = list;
+        timer.prev = NO_ID;
+        timer.next = heads[list];
+        if (timer.next != NO_ID) {
+            timers[timer.next].prev = id;
+        }
+        heads[list] = id;
+    }
+
+    // Reinserts the timers of a list relative to the current tick.
+    void cascade(std::uint32_t list) {
+        std::uint32_t id = heads[list];
+        heads[list] = NO_ID;
+
+        while (id != NO_ID) {
+            std::uint32_t next = timers[id].next;
+            link(id, get_list(timers[id].deadline));
+            id = next;
+        }
+    }
+
+public:
+    void alloc(std::uint32_t capacity, std::uint64_t start = 0) {
+        timers = std::make_unique<Timer[]>(capacity);
+        for (std::uint32_t i = 0; i < capacity; i++) {
+            timers[i].list = NO_ID;
+        }
+        for (std::uint32_t i = 0; i < LIST_COUNT; i++) {
+            heads[i] = NO_ID;
+        }
+        now = start;
+    }
+
+    std::uint64_t get_now() const {
+        return now;
+    }
+
+    bool contains(std::uint32_t id) const {
+        return timers[id].list != NO_ID;
+    }
+
+    // Deadlines in the past expire on the next advance.
+    void insert(std::uint32_t id, std::uint64_t deadline) {
+        if (deadline < now) {
+            deadline = now;
+        }
+
+        timers[id].deadline = deadline;
+        link(id, get_list(deadline));
+    }
+
+    void remove(std::uint32_t id) {
+        Timer& timer = timers[id];
+        if (timer.prev != NO_ID) {
+            timers[timer.prev].next = timer.next;
+        } else {
+            heads[timer.list] = timer.next;
+        }
+
+        if (timer.next != NO_ID) {
+            timers[timer.next].prev = timer.prev;
+        }
+        timer.list = NO_ID;
+    }
+
+    // Unschedules the timers due at the current tick, writes their ids out and
+    // moves to the next tick. The output needs room for every scheduled id.
+    std::uint32_t advance(std::uint32_t* expired_out) {
+        std::uint32_t count = 0;
+
+        std::uint32_t list = now & (SLOT_COUNT - 1);
+        for (std::uint32_t id = heads[list]; id != NO_ID; id = timers[id].next) {
+            timers[id].list = NO_ID;
+            expired_out[count] = id;
+            count++;
+        }
+        heads[list] = NO_ID;
+
+        now++;
+
+        // Higher levels first, so that their timers can still move further down.
+        if ((now & ((std::uint64_t(1) << (SLOT_BITS * LEVEL_COUNT)) - 1)) == 0) {
+            cascade(OVERFLOW_LIST);
+        }
+        for (int level = LEVEL_COUNT - 1; level > 0; level--) {
+            if ((now & ((std::uint64_t(1) << (SLOT_BITS * level)) - 1)) == 0) {
+                std::uint32_t slot = (now >> (SLOT_BITS * level)) & (SLOT_COUNT - 1);
+                cascade(level * SLOT_COUNT + slot);
+            }
+        }
+
+        return count;
+    }
+};
+
+#endif /* __TIMER_WHEEL_H__ */
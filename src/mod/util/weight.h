@@ -0,0 +1,65 @@
+#ifndef __WEIGHT_H__
+#define __WEIGHT_H__
+
+#include <cstdint>
+
+// Arithmetic used by weight trees. Both representations share the same
+// interface, so the trees can be written once and instantiated with either.
+
+struct float_weight {
+    using value_type = double;
+
+    static constexpr bool is_exact = false;
+    static constexpr value_type zero = 0.0;
+    static constexpr value_type one = 1.0;
+
+    static value_type from_double(double value) {
+        return value;
+    }
+
+    static double to_double(value_type value) {
+        return value;
+    }
+
+    // Part of a value given by a ratio in range [0, 1].
+    static value_type scale(value_type value, double ratio) {
+        return value * ratio;
+    }
+
+    static std::size_t to_index(value_type value, value_type unit) {
+        return static_cast<std::size_t>(value / unit);
+    }
+};
+
+// Unsigned 32.32 fixed point. Values wrap around modulo 2^64, which keeps
+// sums of deviations exact as long as the true sum fits into 64 bits.
+struct fixed_weight {
+    using value_type = std::uint64_t;
+
+    static constexpr int fraction_bits = 32;
+    static constexpr bool is_exact = true;
+    static constexpr value_type zero = 0;
+    static constexpr value_type one = value_type(1) << fraction_bits;
+
+    static value_type from_double(double value) {
+        return static_cast<value_type>(value * one);
+    }
+
+    static double to_double(value_type value) {
+        return static_cast<double>(value) / one;
+    }
+
+    // Split into halves, so that no 128-bit product is needed on 32-bit targets.
+    static value_type scale(value_type value, double ratio) {
+        value_type fraction = static_cast<value_type>(ratio * one);
+        value_type high = value >> fraction_bits;
+        value_type low = value & (one - 1);
+        return high * fraction + ((low * fraction) >> fraction_bits);
+    }
+
+    static std::size_t to_index(value_type value, value_type unit) {
+        return static_cast<std::size_t>(value / unit);
+    }
+};
+
+#endif /* __WEIGHT_H__ */
@@ -0,0 +1,51 @@
+#ifndef __XOSHIRO_H__
+#define __XOSHIRO_H__
+
+#include <cstdint>
+
+// xoshiro128** generator, small and fast on 32-bit targets. The state
+// is expanded from a single seed, so a seed fully defines the stream.
+class xoshiro128 {
+private:
+    std::uint32_t state[4];
+
+    static std::uint32_t rotl(std::uint32_t x, int k) {
+        return (x << k) | (x >> (32 - k));
+    }
+
+public:
+    explicit xoshiro128(std::uint32_t seed = 0) {
+        this->seed(seed);
+    }
+
+    // splitmix32 never yields an all zero state.
+    void seed(std::uint32_t seed) {
+        for (int i = 0; i < 4; i++) {
+            std::uint32_t z = (seed += 0x9E3779B9u);
+            z = (z ^ (z >> 16)) * 0x85EBCA6Bu;
+            z = (z ^ (z >> 13)) * 0xC2B2AE35u;
+            state[i] = z ^ (z >> 16);
+        }
+    }
+
+    std::uint32_t next() {
+        std::uint32_t result = rotl(state[1] * 5, 7) * 9;
+        std::uint32_t t = state[1] << 9;
+
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 11);
+
+        return result;
+    }
+
+    // In range [0, 1).
+    double next_double() {
+        return next() * (1.0 / 4294967296.0);
+    }
+};
+
+#endif /* __XOSHIRO_H__ */
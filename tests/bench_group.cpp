@@ -0,0 +1,144 @@
+#include "chaos.h"
+#include "events.h"
+
+#include <iostream>
+#include <chrono>
+
+using namespace Chaos;
+
+constexpr int COMBO_COUNT = 16;
+constexpr int REPEAT_COUNT = 20;
+
+/**
+ * Measures the time needed to build the weight tree of a chaos group
+ * with a given number of effects spread over several tag combos.
+*/
+double bench_init_tree(int effect_count) {
+    std::string tag_names[COMBO_COUNT];
+    Tag::combo_id combos[COMBO_COUNT];
+    for (int i = 0; i < COMBO_COUNT; i++) {
+        tag_names[i] = "bench" + std::to_string(i);
+        const char* tags[] = { tag_names[i].c_str() };
+        combos[i] = Tag::get_combo_id(tags, 1);
+    }
+
+    ChaosGroup group({ /* CHAOS_DISTURBANCE_VERY_LOW */
+        .initial_probability = 0.3f,
+        .on_pick_multiplier = 1.0f,
+        .winner_weight_share = 0.2f,
+        .sampler = ChaosSamplerBackend::TREE,
+    });
+
+    for (int i = 0; i < effect_count; i++) {
+        group.reserve_effect_slot(combos[i % COMBO_COUNT]);
+    }
+
+    group.alloc_effect_slots();
+
+    group.reset_effect_count();
+
+    for (int i = 0; i < effect_count; i++) {
+        Tag::combo_id combo = combos[i % COMBO_COUNT];
+        u32 pos = group.reserve_effect_slot(combo);
+        ChaosEffectEntity& entity = group.get_effect(combo, pos);
+
+        entity.owner = &group;
+        entity.combo = combo;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < REPEAT_COUNT; i++) {
+        group.init_tree();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    std::chrono::duration<double, std::micro> elapsed = end - start;
+    return elapsed.count() / REPEAT_COUNT;
+}
+
+/**
+ * Measures the time per draw of a sampler backend when the picked effect is
+ * activated, and the previous one returned, after every given number of draws.
+ * Only a winner weight share outdates the alias table, so it shows where ALIAS overtakes TREE.
+*/
+double bench_sampler(int effect_count, ChaosSamplerBackend sampler,
+        double winner_weight_share, int draws_per_activation) {
+    constexpr int ACTIVATION_COUNT = 200;
+
+    ChaosGroup group({ /* CHAOS_DISTURBANCE_VERY_LOW */
+        .initial_probability = 0.3f,
+        .on_pick_multiplier = 1.0f,
+        .winner_weight_share = winner_weight_share,
+        .sampler = sampler,
+    });
+
+    Tag::combo_id combo = Tag::get_combo_id(nullptr, 0);
+    for (int i = 0; i < effect_count; i++) {
+        group.reserve_effect_slot(combo);
+    }
+
+    group.alloc_effect_slots();
+
+    group.reset_effect_count();
+
+    for (int i = 0; i < effect_count; i++) {
+        u32 pos = group.reserve_effect_slot(combo);
+        ChaosEffectEntity& entity = group.get_effect(combo, pos);
+
+        entity.owner = &group;
+        entity.combo = combo;
+        entity.status = ChaosEffectStatus::AVAILABLE;
+    }
+
+    group.init_tree();
+
+    xoshiro128 rng(1);
+    ChaosEffectEntity* active = nullptr;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ACTIVATION_COUNT; i++) {
+        ChaosEffectEntity* picked = nullptr;
+        for (int j = 0; j < draws_per_activation; j++) {
+            picked = &group.pick_effect(rng);
+        }
+
+        if (active != nullptr) {
+            group.set_effect_status(*active, ChaosEffectStatus::AVAILABLE);
+        }
+        group.set_effect_status(*picked, ChaosEffectStatus::ACTIVE);
+        active = picked;
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    std::chrono::duration<double, std::micro> elapsed = end - start;
+    return elapsed.count() / (ACTIVATION_COUNT * draws_per_activation);
+}
+
+int main(int argc, const char** argv) {
+    const int effect_counts[] = { 100, 1000, 10000, 100000 };
+
+    for (int effect_count : effect_counts) {
+        double elapsed = bench_init_tree(effect_count);
+        std::cout << "init_tree " << effect_count << " effects: " << elapsed << " us\n";
+    }
+
+    const int sampler_effect_counts[] = { 100, 1000, 10000 };
+    const int draw_counts[] = { 1, 4, 16, 64, 256 };
+    const double weight_shares[] = { 0.0, 0.2 };
+
+    for (double weight_share : weight_shares) {
+        for (int effect_count : sampler_effect_counts) {
+            for (int draw_count : draw_counts) {
+                double tree = bench_sampler(
+                    effect_count, ChaosSamplerBackend::TREE, weight_share, draw_count);
+                double alias = bench_sampler(
+                    effect_count, ChaosSamplerBackend::ALIAS, weight_share, draw_count);
+                std::cout << "draw " << effect_count << " effects, share " << weight_share
+                    << ", " << draw_count << " draws per activation: tree " << tree
+                    << " us, alias " << alias << " us\n";
+            }
+        }
+    }
+
+    return 0;
+}
@@ -9,6 +9,10 @@ void Rand_Seed(u32 seed) {
     // srand(seed);
 }
 
+u32 Rand_Next(void) {
+    return generator();
+}
+
 f32 Rand_ZeroOne(void) {
     return (double)generator() / generator.max();
 }
\ No newline at end of file
@@ -8,6 +8,9 @@ typedef void PlayState;
 typedef unsigned char u8;
 typedef unsigned short u16;
 typedef unsigned int u32;
+typedef unsigned long long u64;
+
+typedef signed int s32;
 
 typedef float f32;
 
@@ -16,6 +19,7 @@ extern "C" {
 #endif
 
 void Rand_Seed(u32 seed);
+u32 Rand_Next(void);
 f32 Rand_ZeroOne(void);
 
 #ifdef __cplusplus
@@ -1,7 +1,9 @@
 #include "chaos.h"
 #include "events.h"
+#include "tag_names.h"
 
 #include <iostream>
+#include <algorithm>
 #include <cassert>
 #include <format>
 
@@ -21,8 +23,32 @@ inline void add_entity(Chaos::ChaosGroup& group, const char* tag_names[], int ta
 
     entity.owner = &group;
     entity.combo = combo;
+    entity.is_waiting = false;
+    entity.active_node = NO_ACTIVE_NODE;
+    entity.instance_block = NO_INSTANCE_BLOCK;
 }
 
+// Tests copy these and only set the fields they need.
+constexpr const ChaosEffect TEST_EFFECT = {
+    .name = "test",
+    .duration = 0,
+
+    .on_start_fun = NULL,
+    .update_fun = NULL,
+    .on_end_fun = NULL,
+    .on_pause_fun = NULL,
+    .on_unpause_fun = NULL,
+};
+
+constexpr const ChaosInstanceSettings TEST_INSTANCE_SETTINGS = {
+    .max_instances = 1,
+    .state_size = 0,
+
+    .on_start_fun = NULL,
+    .update_fun = NULL,
+    .on_end_fun = NULL,
+};
+
 /**
  * Tests allocation of a simple chaos group and a single effect
  * draw.
@@ -32,6 +58,7 @@ void test_tree_weights() {
         .initial_probability = 0.3f,
         .on_pick_multiplier = 1.0f,
         .winner_weight_share = 0.2f,
+        .sampler = ChaosSamplerBackend::TREE,
     });
 
     for (int i = 0; i < 5; i++) {
@@ -78,7 +105,9 @@ void test_weight_balance() {
         .initial_probability = 0.3f,
         .on_pick_multiplier = 1.0f,
         .winner_weight_share = 0.2f,
+        .sampler = ChaosSamplerBackend::TREE,
     });
+    xoshiro128 rng;
 
     for (size_t j = 0; j < GROUP_COUNT; j++) {
         const char** tag_group = tag_groups[j];
@@ -105,7 +134,7 @@ void test_weight_balance() {
     group.init_tree();
 
     for (int i = 0; i < 50000; i++) {
-        group.pick_effect();
+        group.pick_effect(rng);
     }
 
     assert(group.get_weight_sum() - EFFECT_COUNT * GROUP_COUNT < EPSILON);
@@ -135,17 +164,6 @@ void test_status_change() {
 
     constexpr int TOTAL_EFFECT_COUNT = EFFECT_COUNT * GROUP_COUNT;
 
-    constexpr const ChaosEffect test_effect = {
-        .name = "test",
-        .duration = 0,
-
-        .on_start_fun = NULL,
-        .update_fun = NULL,
-        .on_end_fun = NULL,
-        .on_pause_fun = NULL,
-        .on_unpause_fun = NULL,
-    };
-
     Chaos::set_on_init([&]() {
         ChaosMachine* machine = Chaos::get_machine_or_null(0);
 
@@ -155,7 +173,7 @@ void test_status_change() {
 
             for (int i = 0; i < EFFECT_COUNT; i++) {
                 Chaos::register_effect(
-                    machine, test_effect, Disturbance::VERY_LOW, tag_group, tag_count);
+                    machine, TEST_EFFECT, Disturbance::VERY_LOW, tag_group, tag_count);
             }
         }
     });
@@ -220,10 +238,1408 @@ void test_status_change() {
     assert(group.get_weight_sum() == TOTAL_EFFECT_COUNT);
 }
 
+/**
+ * Tests if the alias table sampler keeps the weight bookkeeping intact
+ * and never draws effects which are no longer available.
+*/
+void test_alias_sampler() {
+    constexpr int EFFECT_COUNT = 100;
+    constexpr double EPSILON = 0.000001;
+
+    const char* tags1[] = { "tag1" };
+    constexpr size_t tag_count1 = _countof(tags1);
+
+    ChaosGroup group({ /* CHAOS_DISTURBANCE_VERY_LOW */
+        .initial_probability = 0.3f,
+        .on_pick_multiplier = 1.0f,
+        .winner_weight_share = 0.2f,
+        .sampler = ChaosSamplerBackend::ALIAS,
+    });
+    xoshiro128 rng;
+
+    for (int i = 0; i < EFFECT_COUNT; i++) {
+        reserve_slot(group, NULL, 0);
+        reserve_slot(group, tags1, tag_count1);
+    }
+
+    group.alloc_effect_slots();
+
+    group.reset_effect_count();
+
+    for (int i = 0; i < EFFECT_COUNT; i++) {
+        add_entity(group, NULL, 0);
+        add_entity(group, tags1, tag_count1);
+    }
+
+    group.init_tree();
+
+    for (int i = 0; i < 10000; i++) {
+        group.pick_effect(rng);
+    }
+
+    assert(group.get_weight_sum() - 2 * EFFECT_COUNT < EPSILON);
+
+    Tag::combo_id combo1 = Tag::get_combo_id(tags1, tag_count1);
+    ChaosEffectEntity& disabled = group.get_effect(combo1, 0);
+    group.set_effect_status(disabled, ChaosEffectStatus::DISABLED);
+
+    for (int i = 0; i < 10000; i++) {
+        ChaosEffectEntity& picked = group.pick_effect(rng);
+        assert(&picked != &disabled);
+        assert(picked.status == ChaosEffectStatus::AVAILABLE);
+    }
+}
+
+/**
+ * Checks that the alias sampler keeps drawing available effects in
+ * proportion to their weights after status changes.
+*/
+void test_alias_rejection() {
+    constexpr int EFFECT_COUNT = 4;
+    constexpr int PICK_COUNT = 30000;
+
+    ChaosGroup group({ /* CHAOS_DISTURBANCE_VERY_LOW */
+        .initial_probability = 0.3f,
+        .on_pick_multiplier = 1.0f,
+        .winner_weight_share = 0.0f,
+        .sampler = ChaosSamplerBackend::ALIAS,
+    });
+    xoshiro128 rng(7);
+
+    for (int i = 0; i < EFFECT_COUNT; i++) {
+        reserve_slot(group, NULL, 0);
+    }
+
+    group.alloc_effect_slots();
+
+    group.reset_effect_count();
+
+    for (int i = 0; i < EFFECT_COUNT; i++) {
+        add_entity(group, NULL, 0);
+    }
+
+    group.init_tree();
+    group.pick_effect(rng);
+
+    ChaosEffectEntity& disabled = group.get_effect(0, 0);
+    group.set_effect_status(disabled, ChaosEffectStatus::DISABLED);
+
+    int pick_counts[EFFECT_COUNT] = {};
+    for (int i = 0; i < PICK_COUNT; i++) {
+        ChaosEffectEntity& picked = group.pick_effect(rng);
+        pick_counts[&picked - &group.get_effect(0, 0)]++;
+    }
+
+    assert(pick_counts[0] == 0);
+    for (int i = 1; i < EFFECT_COUNT; i++) {
+        assert(std::abs(pick_counts[i] - PICK_COUNT / 3) < PICK_COUNT / 30);
+    }
+}
+
+/**
+ * Tests if moving the weights to a new offset epoch keeps the weights
+ * of effects and the overall weight sum intact in a small group, where
+ * the shared weight outgrows the effect count quickly.
+*/
+void test_weight_rebase() {
+    constexpr int EFFECT_COUNT = 3;
+    constexpr double EPSILON = 0.000001;
+
+    const char* tags1[] = { "tag1" };
+    constexpr size_t tag_count1 = _countof(tags1);
+
+    ChaosGroup group({ /* CHAOS_DISTURBANCE_NIGHTMARE */
+        .initial_probability = 0.0f,
+        .on_pick_multiplier = 0.5f,
+        .winner_weight_share = 1.0f,
+        .sampler = ChaosSamplerBackend::TREE,
+    });
+    xoshiro128 rng;
+
+    for (int i = 0; i < EFFECT_COUNT; i++) {
+        reserve_slot(group, NULL, 0);
+        reserve_slot(group, tags1, tag_count1);
+    }
+
+    group.alloc_effect_slots();
+
+    group.reset_effect_count();
+
+    for (int i = 0; i < EFFECT_COUNT; i++) {
+        add_entity(group, NULL, 0);
+        add_entity(group, tags1, tag_count1);
+    }
+
+    group.init_tree();
+
+    for (int i = 0; i < 10000; i++) {
+        group.pick_effect(rng);
+
+        double weight_sum = 0.0;
+        for (ChaosEffectEntity& effect : group) {
+            double weight = group.get_effect_weight(effect);
+            assert(weight > -EPSILON);
+            weight_sum += weight;
+        }
+
+        assert(std::abs(weight_sum - group.get_weight_sum()) < EPSILON);
+        assert(std::abs(group.get_weight_sum() - 2 * EFFECT_COUNT) < EPSILON);
+    }
+}
+
+/**
+ * Tests if effects are found at the right positions of the cumulative
+ * weight range, skipping the ones which are not available.
+*/
+void test_effect_by_weight() {
+    constexpr int EFFECT_COUNT = 7;
+
+    ChaosGroup group({ /* CHAOS_DISTURBANCE_VERY_LOW */
+        .initial_probability = 0.3f,
+        .on_pick_multiplier = 1.0f,
+        .winner_weight_share = 0.2f,
+        .sampler = ChaosSamplerBackend::TREE,
+    });
+
+    for (int i = 0; i < EFFECT_COUNT; i++) {
+        reserve_slot(group, NULL, 0);
+    }
+
+    group.alloc_effect_slots();
+
+    group.reset_effect_count();
+
+    for (int i = 0; i < EFFECT_COUNT; i++) {
+        add_entity(group, NULL, 0);
+    }
+
+    group.init_tree();
+
+    for (int i = 0; i < EFFECT_COUNT; i++) {
+        assert(&group.get_effect_entity_by_weight(i + 0.5) == &group.get_effect(0, i));
+    }
+
+    group.set_effect_status(group.get_effect(0, 2), ChaosEffectStatus::DISABLED);
+    group.set_effect_status(group.get_effect(0, 6), ChaosEffectStatus::DISABLED);
+
+    assert(&group.get_effect_entity_by_weight(1.5) == &group.get_effect(0, 1));
+    assert(&group.get_effect_entity_by_weight(2.5) == &group.get_effect(0, 3));
+    assert(&group.get_effect_entity_by_weight(4.5) == &group.get_effect(0, 5));
+    assert(&group.get_effect_entity_by_weight(EFFECT_COUNT) == &group.get_effect(0, 5));
+}
+
+/**
+ * Tests if drawing several effects at once returns distinct available
+ * effects and leaves the weights untouched until a pick is committed.
+*/
+void test_pick_effects() {
+    constexpr int EFFECT_COUNT = 6;
+    constexpr double EPSILON = 0.000001;
+
+    ChaosGroup group({ /* CHAOS_DISTURBANCE_LOW */
+        .initial_probability = 0.2f,
+        .on_pick_multiplier = 1.0f,
+        .winner_weight_share = 0.5f,
+        .sampler = ChaosSamplerBackend::TREE,
+    });
+
+    for (int i = 0; i < EFFECT_COUNT; i++) {
+        reserve_slot(group, NULL, 0);
+    }
+
+    group.alloc_effect_slots();
+
+    group.reset_effect_count();
+
+    for (int i = 0; i < EFFECT_COUNT; i++) {
+        add_entity(group, NULL, 0);
+    }
+
+    group.init_tree();
+
+    group.set_effect_status(group.get_effect(0, 4), ChaosEffectStatus::DISABLED);
+
+    xoshiro128 rng(1234);
+    ChaosEffectEntity* picked[EFFECT_COUNT];
+    for (int i = 0; i < 1000; i++) {
+        size_t picked_count = group.pick_effects(3, picked, false, rng);
+        assert(picked_count == 3);
+
+        for (size_t j = 0; j < picked_count; j++) {
+            assert(picked[j]->status == ChaosEffectStatus::AVAILABLE);
+            for (size_t k = 0; k < j; k++) {
+                assert(picked[j] != picked[k]);
+            }
+        }
+
+        for (int j = 0; j < EFFECT_COUNT; j++) {
+            ChaosEffectEntity& effect = group.get_effect(0, j);
+            assert(std::abs(group.get_effect_weight(effect) - 1.0) < EPSILON);
+        }
+        assert(std::abs(group.get_weight_sum() - (EFFECT_COUNT - 1)) < EPSILON);
+    }
+
+    assert(group.pick_effects(EFFECT_COUNT, picked, false, rng) == EFFECT_COUNT - 1);
+
+    group.commit_pick(*picked[0]);
+    assert(group.get_effect_weight(*picked[0]) < 1.0);
+
+    double weight_sum = 0.0;
+    for (ChaosEffectEntity& effect : group) {
+        weight_sum += group.get_effect_weight(effect);
+    }
+    assert(std::abs(weight_sum - EFFECT_COUNT) < EPSILON);
+}
+
+/**
+ * Tests if the gradual repair of the weight tree keeps the weight sum
+ * exact over a long run of picks across several subgroups.
+*/
+void test_weight_error_reduction() {
+    constexpr int EFFECT_COUNT = 50;
+    constexpr double EPSILON = 0.00000000001;
+
+    const char* tags1[] = { "tag1" };
+    constexpr size_t tag_count1 = _countof(tags1);
+
+    const char* tags2[] = { "tag2" };
+    constexpr size_t tag_count2 = _countof(tags2);
+
+    ChaosGroup group({ /* CHAOS_DISTURBANCE_HIGH */
+        .initial_probability = 0.1f,
+        .on_pick_multiplier = 0.5f,
+        .winner_weight_share = 0.7f,
+        .sampler = ChaosSamplerBackend::TREE,
+    });
+    xoshiro128 rng;
+
+    for (int i = 0; i < EFFECT_COUNT; i++) {
+        reserve_slot(group, NULL, 0);
+        reserve_slot(group, tags1, tag_count1);
+        reserve_slot(group, tags2, tag_count2);
+    }
+
+    group.alloc_effect_slots();
+
+    group.reset_effect_count();
+
+    for (int i = 0; i < EFFECT_COUNT; i++) {
+        add_entity(group, NULL, 0);
+        add_entity(group, tags1, tag_count1);
+        add_entity(group, tags2, tag_count2);
+    }
+
+    group.init_tree();
+
+    for (int i = 0; i < 200000; i++) {
+        group.pick_effect(rng);
+        group.reduce_weight_error();
+    }
+
+    double weight_sum = 0.0;
+    for (ChaosEffectEntity& effect : group) {
+        weight_sum += group.get_effect_weight(effect);
+    }
+
+    assert(std::abs(weight_sum - 3 * EFFECT_COUNT) < EPSILON);
+    assert(std::abs(group.get_weight_sum() - weight_sum) < EPSILON);
+}
+
+/**
+ * Tests if the weight sum of a group never changes with exact weights,
+ * whichever effects get picked.
+*/
+void test_exact_weights() {
+    constexpr int EFFECT_COUNT = 7;
+
+    if constexpr (!ChaosWeight::is_exact) {
+        return;
+    }
+
+    ChaosGroup group({ /* CHAOS_DISTURBANCE_VERY_HIGH */
+        .initial_probability = 0.05f,
+        .on_pick_multiplier = 0.5f,
+        .winner_weight_share = 0.3f,
+        .sampler = ChaosSamplerBackend::ALIAS,
+    });
+    xoshiro128 rng;
+
+    for (int i = 0; i < EFFECT_COUNT; i++) {
+        reserve_slot(group, NULL, 0);
+    }
+
+    group.alloc_effect_slots();
+
+    group.reset_effect_count();
+
+    for (int i = 0; i < EFFECT_COUNT; i++) {
+        add_entity(group, NULL, 0);
+    }
+
+    group.init_tree();
+
+    for (int i = 0; i < 100000; i++) {
+        group.pick_effect(rng);
+        assert(group.get_weight_sum() == EFFECT_COUNT);
+    }
+}
+
+inline void fill_machine(ChaosMachine& machine, int effect_count) {
+    for (int i = 0; i < Disturbance::MAX; i++) {
+        ChaosGroup& group = machine.get_group(static_cast<Disturbance>(i));
+
+        for (int j = 0; j < effect_count; j++) {
+            reserve_slot(group, NULL, 0);
+        }
+
+        group.alloc_effect_slots();
+
+        group.reset_effect_count();
+
+        for (int j = 0; j < effect_count; j++) {
+            add_entity(group, NULL, 0);
+        }
+
+        group.init_tree();
+    }
+}
+
+/**
+ * Tests if two machines with the same seed pick the same effects,
+ * and if setting the seed again replays the sequence.
+*/
+void test_machine_seed() {
+    constexpr int EFFECT_COUNT = 20;
+    constexpr int PICK_COUNT = 500;
+
+    ChaosMachineSettings settings = {
+        .name = "Test",
+        .cycle_length = 0,
+        .default_groups_settings = {
+            { 0.3, 1.0, 0.2, ChaosSamplerBackend::TREE },
+            { 0.2, 1.0, 0.2, ChaosSamplerBackend::TREE },
+            { 0.1, 1.0, 0.2, ChaosSamplerBackend::ALIAS },
+            { 0.05, 1.0, 0.2, ChaosSamplerBackend::TREE },
+            { 0.01, 1.0, 0.2, ChaosSamplerBackend::TREE },
+            { 0.0, 1.0, 0.2, ChaosSamplerBackend::TREE },
+        },
+        .unified_roll = false,
+    };
+
+    ChaosMachine machine1(settings);
+    ChaosMachine machine2(settings);
+    fill_machine(machine1, EFFECT_COUNT);
+    fill_machine(machine2, EFFECT_COUNT);
+
+    machine1.set_seed(42);
+    machine2.set_seed(42);
+    assert(machine1.get_seed() == 42);
+
+    ChaosGroup& group1 = machine1.get_group(Disturbance::VERY_LOW);
+    ChaosGroup& group2 = machine2.get_group(Disturbance::VERY_LOW);
+
+    double randoms[PICK_COUNT];
+    for (int i = 0; i < PICK_COUNT; i++) {
+        ChaosEffectEntity* picked1;
+        ChaosEffectEntity* picked2;
+        assert(machine1.pick_effects(1, &picked1) == 1);
+        assert(machine2.pick_effects(1, &picked2) == 1);
+
+        Disturbance disturbance = machine1.get_group_disturbance(picked1->owner);
+        assert(disturbance == machine2.get_group_disturbance(picked2->owner));
+        assert((picked1 - picked1->owner->begin()) == (picked2 - picked2->owner->begin()));
+    }
+
+    machine1.set_seed(7);
+    for (int i = 0; i < PICK_COUNT; i++) {
+        randoms[i] = machine1.get_random();
+    }
+    machine1.set_seed(7);
+    for (int i = 0; i < PICK_COUNT; i++) {
+        assert(machine1.get_random() == randoms[i]);
+    }
+
+    assert(group1.get_weight_sum() == group2.get_weight_sum());
+}
+
+/**
+ * Tests if a group pick leaves the position of the random value within
+ * the picked group's range, including the range of empty groups before it.
+*/
+void test_unified_roll() {
+    constexpr int EFFECT_COUNT = 4;
+    constexpr double EPSILON = 0.000001;
+
+    ChaosMachineSettings settings = {
+        .name = "Test",
+        .cycle_length = 0,
+        .default_groups_settings = {
+            { 0.3, 1.0, 0.2, ChaosSamplerBackend::TREE },
+            { 0.2, 1.0, 0.2, ChaosSamplerBackend::TREE },
+            { 0.1, 1.0, 0.2, ChaosSamplerBackend::TREE },
+            { 0.05, 1.0, 0.2, ChaosSamplerBackend::TREE },
+            { 0.01, 1.0, 0.2, ChaosSamplerBackend::TREE },
+            { 0.0, 1.0, 0.2, ChaosSamplerBackend::TREE },
+        },
+        .unified_roll = true,
+    };
+
+    ChaosMachine machine(settings);
+    fill_machine(machine, EFFECT_COUNT);
+
+    double residual;
+    ChaosGroup* group = machine.pick_group(0.15, &residual);
+    assert(group == &machine.get_group(Disturbance::VERY_LOW));
+    assert(std::abs(residual - 0.5) < EPSILON);
+
+    group = machine.pick_group(0.45, &residual);
+    assert(group == &machine.get_group(Disturbance::LOW));
+    assert(std::abs(residual - 0.75) < EPSILON);
+
+    ChaosGroup& very_low = machine.get_group(Disturbance::VERY_LOW);
+    for (ChaosEffectEntity& effect : very_low) {
+        very_low.set_effect_status(effect, ChaosEffectStatus::DISABLED);
+    }
+
+    group = machine.pick_group(0.15, &residual);
+    assert(group == &machine.get_group(Disturbance::LOW));
+    assert(std::abs(residual - 0.3) < EPSILON);
+
+    assert(machine.pick_group(0.9, &residual) == nullptr);
+}
+
+/**
+ * Tests if reserving and excluding tags reports exactly the combos whose
+ * allowed state changed, with more tags than fit into a single mask word.
+*/
+void test_tag_masks() {
+    constexpr int TAG_COUNT = 70;
+
+    std::string tag_names[TAG_COUNT];
+    for (int i = 0; i < TAG_COUNT; i++) {
+        tag_names[i] = "mask_tag" + std::to_string(i);
+    }
+
+    const char* first[] = { tag_names[1].c_str() };
+    const char* last[] = { tag_names[TAG_COUNT - 1].c_str() };
+    const char* both[] = { tag_names[1].c_str(), tag_names[TAG_COUNT - 1].c_str() };
+
+    Tag::combo_id first_combo = Tag::get_combo_id(first, 1);
+    for (int i = 0; i < TAG_COUNT; i++) {
+        Tag::add_tag(tag_names[i], 1);
+    }
+    Tag::combo_id last_combo = Tag::get_combo_id(last, 1);
+    Tag::combo_id both_combo = Tag::get_combo_id(both, 2);
+
+    Tag::combo_set affected;
+    Tag::reserve_combo(last_combo, affected);
+    assert(affected.size() == 2);
+    assert(affected.contains(last_combo) && affected.contains(both_combo));
+    assert(Tag::is_combo_allowed(first_combo));
+    assert(!Tag::is_combo_allowed(both_combo));
+
+    Tag::tag_id last_tag = Tag::get_tag_id(tag_names[TAG_COUNT - 1]);
+    affected.clear();
+    assert(Tag::exclude_tag(last_tag, affected));
+    assert(affected.empty());
+    assert(!Tag::is_combo_included(last_combo));
+
+    Tag::free_combo(last_combo, affected);
+    assert(affected.empty());
+    assert(!Tag::is_combo_allowed(last_combo));
+
+    assert(Tag::include_tag(last_tag, affected));
+    assert(affected.size() == 2);
+    assert(Tag::is_combo_allowed(both_combo));
+}
+
+/**
+ * Checks that combos are interned by their set of tags, regardless of
+ * tag order, duplicates of earlier lookups or the number of tags.
+*/
+void test_combo_interning() {
+    constexpr int TAG_COUNT = 40;
+
+    std::vector<std::string> tag_names;
+    for (int i = 0; i < TAG_COUNT; i++) {
+        tag_names.push_back("intern_tag" + std::to_string(i));
+    }
+
+    const char* forward[] = { tag_names[0].c_str(), tag_names[1].c_str() };
+    const char* backward[] = { tag_names[1].c_str(), tag_names[0].c_str() };
+    Tag::combo_id pair_combo = Tag::get_combo_id(forward, 2);
+    assert(pair_combo != 0);
+    assert(Tag::get_combo_id(backward, 2) == pair_combo);
+    assert(Tag::get_combo_id(std::vector<std::string>{ tag_names[1], tag_names[0] }) == pair_combo);
+    assert(Tag::get_combo_id(std::vector<std::string>{}) == 0);
+
+    // Enough combos to grow the table, one of them longer than the inline buffer.
+    std::vector<Tag::combo_id> combos;
+    for (int i = 0; i < TAG_COUNT; i++) {
+        std::vector<std::string> names(tag_names.begin(), tag_names.begin() + i + 1);
+        combos.push_back(Tag::get_combo_id(names));
+    }
+    assert(combos[1] == pair_combo);
+
+    for (int i = TAG_COUNT - 1; i >= 0; i--) {
+        std::vector<std::string> names(tag_names.rbegin() + (TAG_COUNT - i - 1), tag_names.rend());
+        assert(Tag::get_combo_id(names) == combos[i]);
+    }
+}
+
+/**
+ * Checks that built-in tags get their constant handles and that tags
+ * can be forbidden and allowed through handles.
+*/
+void test_tag_handles() {
+    const char* tags[] = { "handle_tag" };
+
+    Chaos::set_on_init([&]() {
+        Chaos::register_effect(
+            Chaos::get_machine_or_null(0), TEST_EFFECT, Disturbance::VERY_LOW, tags, 1);
+    });
+
+    Chaos::init();
+
+    assert(Chaos::get_tag_handle(CHAOS_TAG_PLAYER_INACTIVE) == CHAOS_TAG_HANDLE_PLAYER_INACTIVE);
+    assert(Chaos::get_tag_handle(CHAOS_TAG_CUTSCENE) == CHAOS_TAG_HANDLE_CUTSCENE);
+
+    // Unknown names are rejected instead of creating a tag.
+    assert(Chaos::get_tag_handle("unknown_tag") == Tag::NO_TAG);
+    Chaos::forbid_tag("unknown_tag");
+    assert(Tag::find_tag_id("unknown_tag") == Tag::NO_TAG);
+
+    Tag::tag_id handle = Chaos::get_tag_handle(tags[0]);
+    Tag::combo_id combo = Tag::get_combo_id(tags, 1);
+    assert(!Chaos::is_tag_forbidden(handle));
+
+    ChaosGroup& group = Chaos::get_machine(0).get_group(Disturbance::VERY_LOW);
+    assert(group.get_weight_sum() == 1);
+
+    Chaos::forbid_tag(handle);
+    assert(Chaos::is_tag_forbidden(handle));
+    assert(!Tag::is_combo_allowed(combo));
+    assert(group.get_weight_sum() == 0);
+
+    Chaos::allow_tag(handle);
+    assert(!Chaos::is_tag_forbidden(handle));
+    assert(Tag::is_combo_allowed(combo));
+    assert(group.get_weight_sum() == 1);
+}
+
+/**
+ * Checks that batched tag changes are applied only on commit and that
+ * opposite changes of a tag cancel out.
+*/
+void test_tag_batching() {
+    const char* tags[] = { "batch_tag1", "batch_tag2" };
+
+    Chaos::set_on_init([&]() {
+        ChaosMachine* machine = Chaos::get_machine_or_null(0);
+        Chaos::register_effect(machine, TEST_EFFECT, Disturbance::VERY_LOW, &tags[0], 1);
+        Chaos::register_effect(machine, TEST_EFFECT, Disturbance::VERY_LOW, &tags[1], 1);
+    });
+
+    Chaos::init();
+
+    ChaosGroup& group = Chaos::get_machine(0).get_group(Disturbance::VERY_LOW);
+    Tag::tag_id handle1 = Chaos::get_tag_handle(tags[0]);
+    Tag::tag_id handle2 = Chaos::get_tag_handle(tags[1]);
+
+    Chaos::set_tag_batching(true);
+
+    Chaos::forbid_tag(handle1);
+    Chaos::forbid_tag(handle2);
+    assert(Chaos::is_tag_forbidden(handle1));
+    assert(group.get_weight_sum() == 2);
+
+    Chaos::commit_tag_changes();
+    assert(group.get_weight_sum() == 0);
+
+    Chaos::allow_tag(handle1);
+    Chaos::forbid_tag(handle1);
+    Chaos::allow_tag(handle2);
+    Chaos::commit_tag_changes();
+    assert(Chaos::is_tag_forbidden(handle1));
+    assert(group.get_weight_sum() == 1);
+
+    Chaos::set_tag_batching(false);
+
+    Chaos::allow_tag(handle1);
+    assert(group.get_weight_sum() == 2);
+}
+
+/**
+ * Checks that combos contain the ancestors of their tags, that unregistered
+ * parents don't limit their children and that forbidding a parent blocks
+ * all of its descendants.
+*/
+void test_tag_hierarchy() {
+    const char* fov[] = { "camera.fov" };
+    const char* roll[] = { "camera.roll" };
+    const char* scale[] = { "limited.scale" };
+    const char* tint[] = { "limited.tint" };
+
+    Chaos::set_on_init([&]() {
+        Chaos::register_tag("limited", 1);
+
+        ChaosMachine* machine = Chaos::get_machine_or_null(0);
+        Chaos::register_effect(machine, TEST_EFFECT, Disturbance::VERY_LOW, fov, 1);
+        Chaos::register_effect(machine, TEST_EFFECT, Disturbance::VERY_LOW, roll, 1);
+        Chaos::register_effect(machine, TEST_EFFECT, Disturbance::VERY_LOW, scale, 1);
+        Chaos::register_effect(machine, TEST_EFFECT, Disturbance::VERY_LOW, tint, 1);
+    });
+
+    Chaos::init();
+
+    ChaosGroup& group = Chaos::get_machine(0).get_group(Disturbance::VERY_LOW);
+    Tag::combo_id fov_combo = Tag::get_combo_id(fov, 1);
+    Tag::combo_id roll_combo = Tag::get_combo_id(roll, 1);
+    Tag::combo_id scale_combo = Tag::get_combo_id(scale, 1);
+    Tag::combo_id tint_combo = Tag::get_combo_id(tint, 1);
+
+    const char* fov_with_parent[] = { "camera", "camera.fov" };
+    assert(Tag::get_combo_id(fov_with_parent, 2) == fov_combo);
+    assert(Chaos::get_tag_handle("camera.*") == Chaos::get_tag_handle("camera"));
+
+    Tag::combo_set affected;
+    Tag::reserve_combo(fov_combo, affected);
+    assert(Tag::is_combo_allowed(roll_combo));
+    Tag::free_combo(fov_combo, affected);
+
+    Tag::reserve_combo(scale_combo, affected);
+    assert(!Tag::is_combo_allowed(tint_combo));
+    Tag::free_combo(scale_combo, affected);
+    assert(Tag::is_combo_allowed(tint_combo));
+
+    Chaos::forbid_tag("camera");
+    assert(!Tag::is_combo_allowed(fov_combo) && !Tag::is_combo_allowed(roll_combo));
+    assert(group.get_weight_sum() == 2);
+
+    Chaos::allow_tag("camera");
+    assert(group.get_weight_sum() == 4);
+}
+
+/**
+ * Checks that a queued effect blocked by a reservation waits and starts
+ * once the effect holding the reservation ends.
+*/
+void test_tag_wait_queue() {
+    const char* tags[] = { "wait_tag" };
+
+    ChaosEffect test_effect = TEST_EFFECT;
+    test_effect.duration = 100;
+
+    ChaosEffectEntity* entities[3];
+    Chaos::set_on_init([&]() {
+        ChaosMachine* machine = Chaos::get_machine_or_null(0);
+        for (int i = 0; i < 3; i++) {
+            entities[i] = Chaos::register_effect(
+                machine, test_effect, Disturbance::VERY_LOW, tags, 1);
+        }
+    });
+
+    Chaos::init();
+
+    Chaos::queue_effect(*entities[0]);
+    Chaos::queue_effect(*entities[1]);
+    Chaos::queue_effect(*entities[2]);
+    assert(entities[0]->status == ChaosEffectStatus::ACTIVE);
+    assert(entities[1]->is_waiting && entities[2]->is_waiting);
+
+    Chaos::stop_effect(*entities[2]);
+    Chaos::stop_effect(*entities[0]);
+    Chaos::update(nullptr);
+    assert(entities[0]->status == ChaosEffectStatus::AVAILABLE);
+    assert(entities[1]->status == ChaosEffectStatus::ACTIVE);
+    assert(!entities[1]->is_waiting);
+
+    Chaos::stop_effect(*entities[1]);
+    Chaos::update(nullptr);
+    assert(entities[2]->status == ChaosEffectStatus::AVAILABLE);
+}
+
+u32 start_call_count = 0;
+
+void count_start(GameCtx* play) {
+    start_call_count++;
+}
+
+/**
+ * Checks that a waiting effect which got activated before its tag was woken
+ * is dropped from the queue instead of being started a second time.
+*/
+void test_tag_wait_queue_limit() {
+    const char* tags[] = { "wait_limit_tag" };
+
+    ChaosEffect test_effect = TEST_EFFECT;
+    test_effect.duration = 100;
+    test_effect.on_start_fun = count_start;
+
+    ChaosEffectEntity* entities[3];
+    Chaos::set_on_init([&]() {
+        Chaos::register_tag(tags[0], 2);
+
+        ChaosMachine* machine = Chaos::get_machine_or_null(0);
+        for (int i = 0; i < 3; i++) {
+            entities[i] = Chaos::register_effect(
+                machine, test_effect, Disturbance::VERY_LOW, tags, 1);
+        }
+    });
+
+    Chaos::init();
+    start_call_count = 0;
+
+    for (int i = 0; i < 3; i++) {
+        Chaos::queue_effect(*entities[i]);
+    }
+    assert(entities[2]->is_waiting);
+
+    // Frees the reservations outside of the update, then takes one like a roll would.
+    Chaos::disable_effect(*entities[0]);
+    Chaos::disable_effect(*entities[1]);
+    Chaos::activate_effect(*entities[2]);
+    u32 active_node = entities[2]->active_node;
+
+    Chaos::update(nullptr);
+    assert(!entities[2]->is_waiting);
+    assert(entities[2]->active_node == active_node);
+    assert(start_call_count == 3);
+}
+
+/**
+ * Checks that an effect disabled while waiting for its tag is never started.
+*/
+void test_tag_wait_queue_disable() {
+    const char* tags[] = { "wait_disable_tag" };
+
+    ChaosEffect test_effect = TEST_EFFECT;
+    test_effect.duration = 100;
+    test_effect.on_start_fun = count_start;
+
+    ChaosEffectEntity* entities[2];
+    Chaos::set_on_init([&]() {
+        ChaosMachine* machine = Chaos::get_machine_or_null(0);
+        for (int i = 0; i < 2; i++) {
+            entities[i] = Chaos::register_effect(
+                machine, test_effect, Disturbance::VERY_LOW, tags, 1);
+        }
+    });
+
+    Chaos::init();
+    start_call_count = 0;
+
+    Chaos::queue_effect(*entities[0]);
+    Chaos::queue_effect(*entities[1]);
+    Chaos::disable_effect(*entities[1]);
+    assert(!entities[1]->is_waiting);
+
+    Chaos::stop_effect(*entities[0]);
+    Chaos::update(nullptr);
+    assert(entities[1]->status == ChaosEffectStatus::DISABLED);
+    assert(entities[1]->active_node == NO_ACTIVE_NODE);
+    assert(start_call_count == 1);
+}
+
+/**
+ * Checks that all active effects of a tag are paused and unpaused together
+ * and that paused effects keep their timers.
+*/
+void test_active_effect_pause() {
+    const char* tags[] = { "pause_tag" };
+    constexpr int EFFECT_COUNT = 4;
+
+    ChaosEffect test_effect = TEST_EFFECT;
+    test_effect.duration = 100;
+
+    ChaosEffectEntity* entities[EFFECT_COUNT + 1];
+    Chaos::set_on_init([&]() {
+        Chaos::register_tag(tags[0], SIZE_MAX);
+
+        ChaosMachine* machine = Chaos::get_machine_or_null(0);
+        for (int i = 0; i < EFFECT_COUNT; i++) {
+            entities[i] = Chaos::register_effect(
+                machine, test_effect, Disturbance::VERY_LOW, tags, 1);
+        }
+        entities[EFFECT_COUNT] = Chaos::register_effect(
+            machine, test_effect, Disturbance::VERY_LOW, NULL, 0);
+    });
+
+    Chaos::init();
+
+    ChaosMachine& machine = Chaos::get_machine(0);
+    for (int i = 0; i <= EFFECT_COUNT; i++) {
+        Chaos::activate_effect(*entities[i]);
+    }
+
+    Chaos::update(nullptr);
+    Chaos::forbid_tag(tags[0]);
+    Chaos::update(nullptr);
+    for (int i = 0; i < EFFECT_COUNT; i++) {
+        assert(machine.get_timer(*entities[i]) == 1);
+    }
+    assert(machine.get_timer(*entities[EFFECT_COUNT]) == 2);
+
+    Chaos::allow_tag(tags[0]);
+    Chaos::update(nullptr);
+    for (int i = 0; i < EFFECT_COUNT; i++) {
+        assert(Chaos::get_effect_timer(*entities[i]) == 2);
+    }
+
+    for (int i = 0; i <= EFFECT_COUNT; i++) {
+        Chaos::stop_effect(*entities[i]);
+    }
+    Chaos::update(nullptr);
+    for (int i = 0; i <= EFFECT_COUNT; i++) {
+        assert(entities[i]->status == ChaosEffectStatus::AVAILABLE);
+        assert(entities[i]->active_node == NO_ACTIVE_NODE);
+        assert(Chaos::get_effect_timer(*entities[i]) == 0);
+    }
+}
+
+int update_call_count = 0;
+
+void count_update(GameCtx* ctx) {
+    update_call_count++;
+}
+
+/**
+ * Checks that update callbacks run once per frame while their effect
+ * is running and not while it's paused.
+*/
+void test_effect_update_dispatch() {
+    const char* tags[] = { "dispatch_tag" };
+
+    ChaosEffect update_effect = TEST_EFFECT;
+    update_effect.name = "update";
+    update_effect.duration = 100;
+    update_effect.update_fun = count_update;
+
+    ChaosEffect timer_effect = TEST_EFFECT;
+    timer_effect.name = "timer";
+    timer_effect.duration = 100;
+
+    ChaosEffectEntity* entities[3];
+    Chaos::set_on_init([&]() {
+        ChaosMachine* machine = Chaos::get_machine_or_null(0);
+        entities[0] = Chaos::register_effect(
+            machine, update_effect, Disturbance::VERY_LOW, tags, 1);
+        entities[1] = Chaos::register_effect(
+            machine, update_effect, Disturbance::VERY_LOW, NULL, 0);
+        entities[2] = Chaos::register_effect(
+            machine, timer_effect, Disturbance::VERY_LOW, NULL, 0);
+    });
+
+    Chaos::init();
+
+    update_call_count = 0;
+    for (int i = 0; i < 3; i++) {
+        Chaos::activate_effect(*entities[i]);
+    }
+
+    Chaos::update(nullptr);
+    assert(update_call_count == 2);
+
+    Chaos::forbid_tag(tags[0]);
+    Chaos::update(nullptr);
+    assert(update_call_count == 3);
+    assert(Chaos::get_effect_timer(*entities[2]) == 2);
+
+    Chaos::stop_effect(*entities[1]);
+    Chaos::update(nullptr);
+    assert(update_call_count == 4);
+
+    Chaos::allow_tag(tags[0]);
+    Chaos::update(nullptr);
+    assert(update_call_count == 5);
+}
+
+const char* toggled_tag = "toggle_tag";
+
+void toggle_tag_update(GameCtx* ctx) {
+    update_call_count++;
+    Chaos::forbid_tag(toggled_tag);
+    Chaos::allow_tag(toggled_tag);
+}
+
+/**
+ * Checks that effects paused and unpaused from inside update callbacks
+ * keep a single update entry each, even with every node running.
+*/
+void test_update_tag_toggle() {
+    constexpr int EFFECT_COUNT = 4;
+    const char* tags[] = { toggled_tag };
+
+    ChaosEffect toggle_effect = TEST_EFFECT;
+    toggle_effect.name = "toggle";
+    toggle_effect.duration = 100;
+    toggle_effect.update_fun = toggle_tag_update;
+
+    ChaosEffectEntity* entities[EFFECT_COUNT];
+    Chaos::set_on_init([&]() {
+        Chaos::register_tag(toggled_tag, SIZE_MAX);
+
+        ChaosMachine* machine = Chaos::get_machine_or_null(0);
+        for (int i = 0; i < EFFECT_COUNT; i++) {
+            entities[i] = Chaos::register_effect(
+                machine, toggle_effect, Disturbance::VERY_LOW, tags, 1);
+        }
+    });
+
+    Chaos::init();
+
+    for (int i = 0; i < EFFECT_COUNT; i++) {
+        Chaos::activate_effect(*entities[i]);
+    }
+
+    update_call_count = 0;
+    for (int i = 1; i <= 3; i++) {
+        Chaos::update(nullptr);
+        assert(update_call_count == i * EFFECT_COUNT);
+    }
+
+    for (int i = 0; i < EFFECT_COUNT; i++) {
+        assert(entities[i]->status == ChaosEffectStatus::ACTIVE);
+        assert(Chaos::get_effect_timer(*entities[i]) == 3);
+    }
+}
+
+ChaosEffectEntity* swapped_entities[2];
+bool has_swapped = false;
+
+void swap_effects_update(GameCtx* ctx) {
+    if (!has_swapped) {
+        Chaos::stop_effect(*swapped_entities[0]);
+        Chaos::activate_effect(*swapped_entities[1]);
+        has_swapped = true;
+    }
+}
+
+/**
+ * Checks that effects started from inside update callbacks are first
+ * updated in the next frame, and ones stopped there aren't updated anymore.
+*/
+void test_update_effect_swap() {
+    ChaosEffect swap_effect = TEST_EFFECT;
+    swap_effect.name = "swap";
+    swap_effect.duration = 100;
+    swap_effect.update_fun = swap_effects_update;
+
+    ChaosEffect update_effect = TEST_EFFECT;
+    update_effect.name = "update";
+    update_effect.duration = 100;
+    update_effect.update_fun = count_update;
+
+    ChaosEffectEntity* swap_entity;
+    Chaos::set_on_init([&]() {
+        ChaosMachine* machine = Chaos::get_machine_or_null(0);
+        swap_entity = Chaos::register_effect(
+            machine, swap_effect, Disturbance::VERY_LOW, NULL, 0);
+        for (int i = 0; i < 2; i++) {
+            swapped_entities[i] = Chaos::register_effect(
+                machine, update_effect, Disturbance::VERY_LOW, NULL, 0);
+        }
+    });
+
+    Chaos::init();
+
+    has_swapped = false;
+    Chaos::activate_effect(*swap_entity);
+    Chaos::activate_effect(*swapped_entities[0]);
+
+    update_call_count = 0;
+    Chaos::update(nullptr);
+    // Stopped effects are updated a last time when they're removed.
+    assert(update_call_count == 1);
+    assert(swapped_entities[0]->status == ChaosEffectStatus::AVAILABLE);
+    assert(swapped_entities[1]->status == ChaosEffectStatus::ACTIVE);
+
+    for (int i = 1; i <= 3; i++) {
+        Chaos::update(nullptr);
+        assert(update_call_count == i + 1);
+    }
+}
+
+/**
+ * Checks that timers of the wheel expire exactly at their deadlines,
+ * including ones far enough to pass through every level.
+*/
+void test_timer_wheel() {
+    constexpr u32 TIMER_COUNT = 64;
+
+    timer_wheel wheel;
+    wheel.alloc(TIMER_COUNT, 100);
+
+    u64 deadlines[TIMER_COUNT];
+    xoshiro128 rng(7);
+    for (u32 i = 0; i < TIMER_COUNT; i++) {
+        u64 delay = rng.next() >> (rng.next() % 32);
+        deadlines[i] = 100 + (delay % (1 << 26));
+        wheel.insert(i, deadlines[i]);
+    }
+    deadlines[0] = 100;
+    wheel.remove(0);
+    wheel.insert(0, deadlines[0]);
+    wheel.remove(1);
+
+    u32 expired[TIMER_COUNT];
+    u32 expired_total = 0;
+    u64 last_deadline = 0;
+    for (u32 i = 2; i < TIMER_COUNT; i++) {
+        last_deadline = std::max(last_deadline, deadlines[i]);
+    }
+
+    while (wheel.get_now() <= last_deadline) {
+        u64 now = wheel.get_now();
+        u32 count = wheel.advance(expired);
+        for (u32 i = 0; i < count; i++) {
+            assert(expired[i] != 1);
+            assert(deadlines[expired[i]] == now);
+        }
+        expired_total += count;
+    }
+    assert(expired_total == TIMER_COUNT - 1);
+}
+
+/**
+ * Checks that effects end after duration + 1 updates and that pausing
+ * shifts the end by the paused frames.
+*/
+void test_effect_expiry() {
+    const char* tags[] = { "expiry_tag" };
+    constexpr u32 DURATION = 70;
+    constexpr u32 PAUSE_LENGTH = 5;
+
+    ChaosEffect test_effect = TEST_EFFECT;
+    test_effect.duration = DURATION;
+
+    ChaosEffectEntity* entities[2];
+    Chaos::set_on_init([&]() {
+        ChaosMachine* machine = Chaos::get_machine_or_null(0);
+        entities[0] = Chaos::register_effect(
+            machine, test_effect, Disturbance::VERY_LOW, NULL, 0);
+        entities[1] = Chaos::register_effect(
+            machine, test_effect, Disturbance::VERY_LOW, tags, 1);
+    });
+
+    Chaos::init();
+
+    Chaos::activate_effect(*entities[0]);
+    Chaos::activate_effect(*entities[1]);
+
+    Chaos::forbid_tag(tags[0]);
+    for (u32 i = 0; i < PAUSE_LENGTH; i++) {
+        Chaos::update(nullptr);
+    }
+    Chaos::allow_tag(tags[0]);
+
+    for (u32 i = PAUSE_LENGTH; i < DURATION; i++) {
+        Chaos::update(nullptr);
+    }
+    assert(Chaos::get_effect_timer(*entities[0]) == DURATION);
+    assert(Chaos::get_effect_timer(*entities[1]) == DURATION - PAUSE_LENGTH);
+
+    Chaos::update(nullptr);
+    assert(entities[0]->status == ChaosEffectStatus::AVAILABLE);
+    assert(entities[1]->status == ChaosEffectStatus::ACTIVE);
+
+    for (u32 i = 0; i < PAUSE_LENGTH; i++) {
+        Chaos::update(nullptr);
+    }
+    assert(entities[1]->status == ChaosEffectStatus::AVAILABLE);
+}
+
+/**
+ * Checks that an effect with a cooldown stays hidden and out of the weight
+ * tree for the cooldown frames after ending, then becomes available again.
+*/
+void test_effect_cooldown() {
+    constexpr u32 COOLDOWN = 3;
+
+    ChaosEffectEntity* entities[2];
+    Chaos::set_on_init([&]() {
+        ChaosMachine* machine = Chaos::get_machine_or_null(0);
+        for (int i = 0; i < 2; i++) {
+            entities[i] = Chaos::register_effect(
+                machine, TEST_EFFECT, Disturbance::VERY_LOW, NULL, 0);
+        }
+    });
+
+    Chaos::init();
+
+    ChaosGroup& group = Chaos::get_machine(0).get_group(Disturbance::VERY_LOW);
+    Chaos::set_effect_cooldown(*entities[0], COOLDOWN);
+
+    Chaos::activate_effect(*entities[0]);
+    Chaos::activate_effect(*entities[1]);
+    Chaos::update(nullptr);
+    assert(entities[0]->status == ChaosEffectStatus::HIDDEN);
+    assert(entities[1]->status == ChaosEffectStatus::AVAILABLE);
+    assert(group.get_weight_sum() == 1);
+
+    for (u32 i = 1; i < COOLDOWN; i++) {
+        Chaos::update(nullptr);
+        assert(entities[0]->status == ChaosEffectStatus::HIDDEN);
+    }
+
+    Chaos::update(nullptr);
+    assert(entities[0]->status == ChaosEffectStatus::AVAILABLE);
+    assert(entities[0]->active_node == NO_ACTIVE_NODE);
+    assert(group.get_weight_sum() == 2);
+}
+
+/**
+ * Checks that an effect activated again during its cooldown gets the full
+ * cooldown after it ends again, without leaking the cooling node.
+*/
+void test_effect_cooldown_restart() {
+    constexpr u32 COOLDOWN = 3;
+    constexpr int CYCLE_COUNT = 200;
+
+    ChaosEffect cooling_effect = TEST_EFFECT;
+    cooling_effect.duration = 1;
+
+    ChaosEffectEntity* entity;
+    Chaos::set_on_init([&]() {
+        ChaosMachine* machine = Chaos::get_machine_or_null(0);
+        entity = Chaos::register_effect(
+            machine, cooling_effect, Disturbance::VERY_LOW, NULL, 0);
+    });
+
+    Chaos::init();
+    Chaos::set_effect_cooldown(*entity, COOLDOWN);
+
+    Chaos::activate_effect(*entity);
+    Chaos::update(nullptr);
+    Chaos::update(nullptr);
+    assert(entity->status == ChaosEffectStatus::HIDDEN);
+
+    for (int i = 0; i < CYCLE_COUNT; i++) {
+        Chaos::activate_effect(*entity);
+        assert(entity->status == ChaosEffectStatus::ACTIVE);
+
+        Chaos::update(nullptr);
+        Chaos::update(nullptr);
+        for (u32 j = 1; j < COOLDOWN; j++) {
+            assert(entity->status == ChaosEffectStatus::HIDDEN);
+            Chaos::update(nullptr);
+        }
+        assert(entity->status == ChaosEffectStatus::HIDDEN);
+    }
+
+    Chaos::update(nullptr);
+    assert(entity->status == ChaosEffectStatus::AVAILABLE);
+    assert(entity->active_node == NO_ACTIVE_NODE);
+}
+
+void count_instance_update(GameCtx* play, u32 instance, void* state) {
+    (*static_cast<u32*>(state))++;
+}
+
+/**
+ * Checks that an instanced effect can be rolled until all of its instances
+ * run, and that every instance updates its own state.
+*/
+void test_effect_instances() {
+    constexpr u32 MAX_INSTANCES = 3;
+
+    ChaosEffect test_effect = TEST_EFFECT;
+    test_effect.duration = 10;
+
+    ChaosInstanceSettings instance_settings = TEST_INSTANCE_SETTINGS;
+    instance_settings.max_instances = MAX_INSTANCES;
+    instance_settings.state_size = sizeof(u32);
+    instance_settings.update_fun = count_instance_update;
+
+    ChaosEffectEntity* entity;
+    Chaos::set_on_init([&]() {
+        ChaosMachine* machine = Chaos::get_machine_or_null(0);
+        entity = Chaos::register_instanced_effect(
+            machine, test_effect, Disturbance::VERY_LOW, NULL, 0, instance_settings);
+    });
+
+    Chaos::init();
+
+    ChaosGroup& group = Chaos::get_machine(0).get_group(Disturbance::VERY_LOW);
+
+    Chaos::activate_effect(*entity);
+    Chaos::update(nullptr);
+    Chaos::activate_effect(*entity);
+    assert(entity->status == ChaosEffectStatus::ACTIVE);
+    assert(Chaos::get_effect_instance_count(*entity) == 2);
+    assert(group.get_weight_sum() == 1);
+
+    Chaos::activate_effect(*entity);
+    assert(entity->status == ChaosEffectStatus::ACTIVE);
+    assert(group.get_weight_sum() == 0);
+
+    Chaos::update(nullptr);
+    u32 updates[MAX_INSTANCES];
+    for (u32 i = 0; i < MAX_INSTANCES; i++) {
+        updates[i] = *static_cast<u32*>(Chaos::get_effect_instance_state(*entity, i));
+    }
+    assert(updates[0] + updates[1] + updates[2] == 4);
+    assert(std::max({ updates[0], updates[1], updates[2] }) == 2);
+
+    Chaos::stop_effect(*entity);
+    Chaos::update(nullptr);
+    assert(entity->status == ChaosEffectStatus::AVAILABLE);
+    assert(Chaos::get_effect_instance_count(*entity) == 0);
+    assert(Chaos::get_effect_instance_state(*entity, 0) == nullptr);
+    assert(group.get_weight_sum() == 1);
+}
+
+ChaosEffectEntity* restarted_entity;
+u32 restart_count = 0;
+u32 instance_end_count = 0;
+u32 ended_instance_updates = 0;
+
+void restart_instance_end(GameCtx* play, u32 instance, void* state) {
+    instance_end_count++;
+    ended_instance_updates = *static_cast<u32*>(state);
+    if (restart_count > 0) {
+        restart_count--;
+        Chaos::activate_effect(*restarted_entity);
+    }
+}
+
+/**
+ * Checks that an instance can start its effect again from its end callback,
+ * which still sees its state, and that the restarted instances end normally.
+*/
+void test_effect_instance_restart() {
+    constexpr u32 DURATION = 2;
+    constexpr u32 RESTART_COUNT = 3;
+
+    ChaosEffect test_effect = TEST_EFFECT;
+    test_effect.duration = DURATION;
+
+    ChaosInstanceSettings instance_settings = TEST_INSTANCE_SETTINGS;
+    instance_settings.state_size = sizeof(u32);
+    instance_settings.update_fun = count_instance_update;
+    instance_settings.on_end_fun = restart_instance_end;
+
+    Chaos::set_on_init([&]() {
+        ChaosMachine* machine = Chaos::get_machine_or_null(0);
+        restarted_entity = Chaos::register_instanced_effect(
+            machine, test_effect, Disturbance::VERY_LOW, NULL, 0, instance_settings);
+    });
+
+    Chaos::init();
+
+    ChaosGroup& group = Chaos::get_machine(0).get_group(Disturbance::VERY_LOW);
+
+    restart_count = RESTART_COUNT;
+    instance_end_count = 0;
+    Chaos::activate_effect(*restarted_entity);
+    for (u32 i = 0; i <= DURATION; i++) {
+        Chaos::update(nullptr);
+    }
+    assert(instance_end_count == 1);
+    assert(ended_instance_updates == DURATION + 1);
+    assert(restarted_entity->status == ChaosEffectStatus::ACTIVE);
+    assert(Chaos::get_effect_instance_count(*restarted_entity) == 1);
+
+    for (u32 i = 0; i < RESTART_COUNT * (DURATION + 1); i++) {
+        Chaos::update(nullptr);
+    }
+    assert(instance_end_count == RESTART_COUNT + 1);
+    assert(ended_instance_updates == DURATION + 1);
+    assert(restarted_entity->status == ChaosEffectStatus::AVAILABLE);
+    assert(Chaos::get_effect_instance_count(*restarted_entity) == 0);
+    assert(group.get_weight_sum() == 1);
+}
+
+/**
+ * Checks that instances hold the tags of their effect from the first start
+ * to the last end, and that the cooldown only starts after the last one.
+*/
+void test_effect_instance_tags() {
+    constexpr u32 DURATION = 4;
+    constexpr u32 COOLDOWN = 2;
+    const char* tags[] = { "stack_tag" };
+
+    ChaosEffect test_effect = TEST_EFFECT;
+    test_effect.duration = DURATION;
+
+    ChaosInstanceSettings instance_settings = TEST_INSTANCE_SETTINGS;
+    instance_settings.max_instances = 2;
+
+    ChaosEffectEntity* entities[2];
+    Chaos::set_on_init([&]() {
+        Chaos::register_tag(tags[0], 1);
+
+        ChaosMachine* machine = Chaos::get_machine_or_null(0);
+        entities[0] = Chaos::register_instanced_effect(
+            machine, test_effect, Disturbance::VERY_LOW, tags, 1, instance_settings);
+        entities[1] = Chaos::register_effect(
+            machine, test_effect, Disturbance::VERY_LOW, tags, 1);
+    });
+
+    Chaos::init();
+    Chaos::set_effect_cooldown(*entities[0], COOLDOWN);
+
+    Chaos::activate_effect(*entities[0]);
+    Chaos::activate_effect(*entities[1]);
+    assert(entities[0]->status == ChaosEffectStatus::ACTIVE);
+    assert(entities[1]->status == ChaosEffectStatus::AVAILABLE);
+
+    Chaos::update(nullptr);
+    Chaos::update(nullptr);
+    Chaos::activate_effect(*entities[0]);
+    assert(Chaos::get_effect_instance_count(*entities[0]) == 2);
+
+    for (u32 i = 2; i <= DURATION; i++) {
+        Chaos::update(nullptr);
+    }
+    assert(Chaos::get_effect_instance_count(*entities[0]) == 1);
+    assert(entities[0]->status == ChaosEffectStatus::ACTIVE);
+    assert(!Tag::is_combo_allowed(entities[1]->combo));
+
+    Chaos::update(nullptr);
+    Chaos::update(nullptr);
+    assert(Chaos::get_effect_instance_count(*entities[0]) == 0);
+    assert(entities[0]->status == ChaosEffectStatus::HIDDEN);
+    assert(Tag::is_combo_allowed(entities[1]->combo));
+
+    for (u32 i = 0; i < COOLDOWN; i++) {
+        Chaos::update(nullptr);
+    }
+    assert(entities[0]->status == ChaosEffectStatus::AVAILABLE);
+}
+
 int main(int argc, const char** argv) {
     test_tree_weights();
     test_weight_balance();
     test_status_change();
+    test_alias_sampler();
+    test_alias_rejection();
+    test_weight_rebase();
+    test_effect_by_weight();
+    test_pick_effects();
+    test_weight_error_reduction();
+    test_exact_weights();
+    test_machine_seed();
+    test_unified_roll();
+    test_tag_masks();
+    test_combo_interning();
+    test_tag_handles();
+    test_tag_batching();
+    test_tag_hierarchy();
+    test_tag_wait_queue();
+    test_tag_wait_queue_limit();
+    test_tag_wait_queue_disable();
+    test_active_effect_pause();
+    test_effect_update_dispatch();
+    test_update_tag_toggle();
+    test_update_effect_swap();
+    test_timer_wheel();
+    test_effect_expiry();
+    test_effect_cooldown();
+    test_effect_cooldown_restart();
+    test_effect_instances();
+    test_effect_instance_restart();
+    test_effect_instance_tags();
 
     return 0;
 }
\ No newline at end of file